@@ -1,6 +1,13 @@
-#include <bits/stdc++.h>
-
+// PointerIntPair.h
+#ifndef POINTER_INT_PAIR_H
+#define POINTER_INT_PAIR_H
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 
 /// A traits type that is used to handle pointer types and things that are just
 /// wrappers for pointers as a uniform entity.
@@ -450,4 +457,6 @@ get(const PointerIntPair<PointerTy, IntBits, IntType, PtrTraits, Info> &Pair)
         return Pair.getPointer();
     else
         return Pair.getInt();
-}
\ No newline at end of file
+}
+
+#endif
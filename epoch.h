@@ -0,0 +1,273 @@
+// epoch.h
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Epoch-based reclamation (Fraser), shared by every lock-free structure of the
+// process. A thread reads shared nodes inside an EpochGuard, which publishes the
+// global epoch it started in. A node that is unlinked goes to Epoch::retire() instead
+// of delete and waits in the retiring thread's limbo list, tagged with the epoch the
+// retiring thread is pinned in. The global epoch only moves from e to e + 1 once no
+// thread is pinned in an older one, so a thread that could still see the node was
+// pinned in the tag or the one after, and the node is freed once the global epoch is
+// three past the tag.
+//
+// Readers pay one barrier to enter a guard and nothing per node. The price is that
+// a thread stalled inside a guard holds back all reclamation.
+//
+// Whole tables are retired with their size. They are few and holding them back is
+// expensive, so they go to a list shared by all threads and every such retire tries
+// to free them, whoever retired them. synchronize() waits for them.
+class Epoch
+{
+public:
+    using Deleter = void (*)(void *);
+
+private:
+    static constexpr uint64_t QUIESCENT = UINT64_MAX; // epoch of a thread outside any guard
+    // Retires between two tries at moving the epoch and freeing what is safe to free.
+    static constexpr size_t COLLECT_EVERY = 64;
+    // Epochs a retired node waits, and the limbo lists that takes.
+    static constexpr uint64_t GRACE = 3;
+    static constexpr size_t LIMBO = GRACE + 1;
+    // Retires of at least this many bytes go to the shared list.
+    static constexpr size_t LARGE_BYTES = 64 * 1024;
+
+    struct Retired
+    {
+        void *ptr;
+        Deleter free;
+    };
+
+    struct LargeRetired
+    {
+        Retired obj;
+        uint64_t epoch;
+    };
+
+    // One per thread, taken from the registry and handed back when the thread exits.
+    // Records are never freed, so a scan of the registry needs no protection. A
+    // record that is handed back keeps its limbo lists for the next thread to free.
+    struct alignas(64) Record
+    {
+        std::atomic<uint64_t> epoch{QUIESCENT};
+        std::atomic<bool> in_use{true};
+        Record *next = nullptr;
+        // owner only from here on
+        unsigned int depth = 0;
+        std::vector<Retired> limbo[LIMBO]; // limbo[e % LIMBO] holds what was retired in epoch limbo_epoch[e % LIMBO]
+        uint64_t limbo_epoch[LIMBO] = {};
+        size_t since_collect = 0;
+    };
+
+    static inline std::atomic<uint64_t> global_epoch{1};
+    static inline std::atomic<Record *> registry{nullptr};
+    static inline std::mutex large_mtx;
+    // never destroyed, like the records, so it still works while the process exits
+    static inline std::vector<LargeRetired> &large = *new std::vector<LargeRetired>();
+
+    struct Handle
+    {
+        Record *rec;
+
+        Handle()
+        {
+            for (rec = registry.load(std::memory_order_acquire); rec != nullptr; rec = rec->next)
+            {
+                bool free = false;
+                if (!rec->in_use.load(std::memory_order_relaxed) &&
+                    rec->in_use.compare_exchange_strong(free, true, std::memory_order_acquire))
+                    return;
+            }
+            rec = new Record();
+            Record *head = registry.load(std::memory_order_relaxed);
+            do
+            {
+                rec->next = head;
+            } while (!registry.compare_exchange_weak(head, rec, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        ~Handle()
+        {
+            rec->epoch.store(QUIESCENT, std::memory_order_release);
+            rec->in_use.store(false, std::memory_order_release);
+        }
+    };
+
+    static Record *local()
+    {
+        static thread_local Handle handle;
+        return handle.rec;
+    }
+
+    static void free_all(std::vector<Retired> &limbo)
+    {
+        for (const Retired &r : limbo)
+        {
+            r.free(r.ptr);
+        }
+        limbo.clear();
+    }
+
+    // Moves the global epoch on if every pinned thread has seen the current one, returns
+    // false if one hasn't. The acquire loads pair with unpin(), so the reads of a thread
+    // that has left its guard happen before anything freed after the epoch moved.
+    static bool try_advance()
+    {
+        uint64_t e = global_epoch.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (Record *r = registry.load(std::memory_order_acquire); r != nullptr; r = r->next)
+        {
+            uint64_t re = r->epoch.load(std::memory_order_acquire);
+            if (re != QUIESCENT && re != e)
+                return false;
+        }
+        // a failed CAS means someone else moved it
+        global_epoch.compare_exchange_strong(e, e + 1, std::memory_order_acq_rel, std::memory_order_relaxed);
+        return true;
+    }
+
+    // frees the limbo lists of rec whose grace period is over
+    static void collect(Record *rec)
+    {
+        uint64_t e = global_epoch.load(std::memory_order_acquire);
+        for (size_t i = 0; i < LIMBO; ++i)
+        {
+            if (!rec->limbo[i].empty() && rec->limbo_epoch[i] + GRACE <= e)
+                free_all(rec->limbo[i]);
+        }
+    }
+
+    // frees the large objects whose grace period is over, retired by any thread
+    static void collect_large()
+    {
+        std::vector<Retired> expired;
+        {
+            std::lock_guard<std::mutex> lock(large_mtx);
+            uint64_t e = global_epoch.load(std::memory_order_acquire);
+            size_t kept = 0;
+            for (const LargeRetired &r : large)
+            {
+                if (r.epoch + GRACE <= e)
+                    expired.push_back(r.obj);
+                else
+                    large[kept++] = r;
+            }
+            large.resize(kept);
+        }
+        free_all(expired);
+    }
+
+public:
+    // Enters a guard, guards nest. Returns this thread's record for unpin().
+    static void *pin()
+    {
+        Record *rec = local();
+        if (rec->depth++ == 0)
+        {
+            uint64_t e = global_epoch.load(std::memory_order_acquire);
+            // The epoch has to be visible before any shared node is read. A locked
+            // exchange is a full barrier on x86 and cheaper than a fence.
+#if defined(__x86_64__) || defined(__i386__)
+            rec->epoch.exchange(e, std::memory_order_seq_cst);
+#else
+            rec->epoch.store(e, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+        }
+        return rec;
+    }
+
+    static void unpin(void *token)
+    {
+        Record *rec = static_cast<Record *>(token);
+        if (--rec->depth == 0)
+            rec->epoch.store(QUIESCENT, std::memory_order_release);
+    }
+
+    // Hands ptr to free(ptr) once no guard can still see it. ptr must already be
+    // unreachable for threads that enter a guard from now on. bytes is the memory
+    // free(ptr) gives back, it only matters for large objects.
+    static void retire(void *ptr, Deleter free, size_t bytes = 0)
+    {
+        void *token = pin();
+        Record *rec = static_cast<Record *>(token);
+        uint64_t e = rec->epoch.load(std::memory_order_relaxed);
+        if (bytes >= LARGE_BYTES)
+        {
+            {
+                std::lock_guard<std::mutex> lock(large_mtx);
+                large.push_back({{ptr, free}, e});
+            }
+            unpin(token);
+            // with nobody pinned in an old epoch it can go right away
+            for (uint64_t n = 0; n < GRACE && try_advance(); ++n)
+            {
+            }
+            collect_large();
+            return;
+        }
+        size_t i = e % LIMBO;
+        if (rec->limbo_epoch[i] != e)
+        {
+            // retired in epoch e - LIMBO or earlier, the grace period is over
+            free_all(rec->limbo[i]);
+            rec->limbo_epoch[i] = e;
+        }
+        rec->limbo[i].push_back({ptr, free});
+        if (++rec->since_collect >= COLLECT_EVERY)
+        {
+            rec->since_collect = 0;
+            try_advance();
+            collect(rec);
+        }
+        unpin(token);
+    }
+
+    template <typename T>
+    static void retire(T *ptr, size_t bytes = sizeof(T))
+    {
+        retire(ptr, [](void *p)
+               { delete static_cast<T *>(p); }, bytes);
+    }
+
+    // Waits until everything retired before the call is past its grace period, then
+    // frees the large objects and this thread's limbo lists. Must not be called inside
+    // a guard, it would wait for itself.
+    static void synchronize()
+    {
+        Record *rec = local();
+        assert(rec->depth == 0);
+        uint64_t target = global_epoch.load(std::memory_order_acquire) + GRACE;
+        while (global_epoch.load(std::memory_order_acquire) < target)
+        {
+            try_advance();
+            if (global_epoch.load(std::memory_order_acquire) < target)
+                std::this_thread::yield(); // someone is still pinned in an older epoch
+        }
+        collect_large();
+        collect(rec);
+    }
+};
+
+// Scope in which the nodes of lock-free structures read by this thread stay allocated.
+class EpochGuard
+{
+private:
+    void *token;
+
+public:
+    EpochGuard() : token(Epoch::pin()) {}
+    ~EpochGuard() { Epoch::unpin(token); }
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard &operator=(const EpochGuard &) = delete;
+};
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef USE_TBB
+#include "cuckoo_hash_table.h"
+#include <algorithm>
+#include <optional>
+#include <thread>
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t cap = 1;
+    while (cap < n)
+        cap <<= 1;
+    return cap;
+}
+
+CuckooHashTable::CuckooHashTable(size_t cap) : size(0), reserved(0), stripes(NUM_STRIPES)
+{
+    // cap entries at 90% occupancy
+    size_t buckets = cap * 10 / 9 / CuckooBucket::SLOTS + 1;
+    current.store(new CuckooBuckets(round_up_pow2(std::max(buckets, NUM_STRIPES))), std::memory_order_release);
+}
+
+CuckooHashTable::~CuckooHashTable()
+{
+    delete current.load();
+    for (CuckooBuckets *b : retired)
+    {
+        delete b;
+    }
+}
+
+void CuckooHashTable::lock_pair(size_t a, size_t b)
+{
+    // always in stripe order, so two inserts can't deadlock
+    if (a > b)
+        std::swap(a, b);
+    stripes[a].lock.lock();
+    if (b != a)
+        stripes[b].lock.lock();
+}
+
+void CuckooHashTable::unlock_pair(size_t a, size_t b)
+{
+    stripes[a].lock.unlock();
+    if (b != a)
+        stripes[b].lock.unlock();
+}
+
+CuckooHashTable::Path CuckooHashTable::find_path(const CuckooBuckets *b, size_t i1, size_t i2)
+{
+    // a visited bucket, and the slot of its parent whose key would move into it
+    struct Visit
+    {
+        size_t bucket;
+        int parent;
+        int slot;
+        uint32_t key;
+        int depth;
+    };
+    Visit queue[MAX_VISITS];
+    size_t queued = 0;
+    queue[queued++] = {i1, -1, -1, CK_EMPTY_KEY, 1};
+    if (i2 != i1)
+        queue[queued++] = {i2, -1, -1, CK_EMPTY_KEY, 1};
+
+    // Reads are unlocked, the path is checked again while it is moved.
+    Path path;
+    for (size_t h = 0; h < queued; ++h)
+    {
+        const Visit v = queue[h];
+        const CuckooBucket &bucket = b->buckets[v.bucket];
+        for (int s = 0; s < CuckooBucket::SLOTS; ++s)
+        {
+            if (bucket.slots[s].load(std::memory_order_relaxed) != CK_EMPTY)
+                continue;
+            path.length = v.depth;
+            path.hops[v.depth - 1] = {v.bucket, s, CK_EMPTY_KEY};
+            for (int c = static_cast<int>(h); queue[c].parent >= 0; c = queue[c].parent)
+            {
+                path.hops[queue[c].depth - 2] = {queue[queue[c].parent].bucket, queue[c].slot, queue[c].key};
+            }
+            return path;
+        }
+        if (v.depth >= MAX_PATH)
+            continue;
+        for (int s = 0; s < CuckooBucket::SLOTS && queued < MAX_VISITS; ++s)
+        {
+            uint32_t key = bucket.slots[s].load(std::memory_order_relaxed) >> 32;
+            size_t a = b->alt(key, v.bucket);
+            if (a != v.bucket)
+                queue[queued++] = {a, static_cast<int>(h), s, key, v.depth + 1};
+        }
+    }
+    return path;
+}
+
+bool CuckooHashTable::move_path(CuckooBuckets *b, const Path &path)
+{
+    // Last hop first: every move fills the free slot and frees the one before it.
+    for (int j = path.length - 1; j > 0; --j)
+    {
+        const Hop &from = path.hops[j - 1];
+        const Hop &to = path.hops[j];
+        size_t sa = from.bucket & (NUM_STRIPES - 1);
+        size_t sb = to.bucket & (NUM_STRIPES - 1);
+        lock_pair(sa, sb);
+        std::atomic<uint64_t> &src = b->buckets[from.bucket].slots[from.slot];
+        std::atomic<uint64_t> &dst = b->buckets[to.bucket].slots[to.slot];
+        uint64_t w = src.load(std::memory_order_relaxed);
+        bool ok = current.load(std::memory_order_relaxed) == b && (w >> 32) == from.key &&
+                  dst.load(std::memory_order_relaxed) == CK_EMPTY;
+        if (ok)
+        {
+            // the key is in neither bucket for a moment, readers of either stripe retry
+            SeqWriter wa(stripes[sa].seq);
+            std::optional<SeqWriter> wb;
+            if (sb != sa)
+                wb.emplace(stripes[sb].seq);
+            dst.store(w, std::memory_order_relaxed);
+            src.store(CK_EMPTY, std::memory_order_relaxed);
+        }
+        unlock_pair(sa, sb);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+bool CuckooHashTable::rehash(const CuckooBuckets *from, CuckooBuckets *to)
+{
+    for (size_t i = 0; i < from->capacity; ++i)
+    {
+        for (int s = 0; s < CuckooBucket::SLOTS; ++s)
+        {
+            uint64_t w = from->buckets[i].slots[s].load(std::memory_order_relaxed);
+            if (w == CK_EMPTY)
+                continue;
+            uint32_t key = w >> 32;
+            while (true)
+            {
+                std::atomic<uint64_t> *free_slot = nullptr;
+                for (size_t j : {to->first(key), to->second(key)})
+                {
+                    for (int t = 0; t < CuckooBucket::SLOTS && free_slot == nullptr; ++t)
+                    {
+                        if (to->buckets[j].slots[t].load(std::memory_order_relaxed) == CK_EMPTY)
+                            free_slot = &to->buckets[j].slots[t];
+                    }
+                }
+                if (free_slot != nullptr)
+                {
+                    free_slot->store(w, std::memory_order_relaxed);
+                    break;
+                }
+                Path path = find_path(to, to->first(key), to->second(key));
+                if (path.length == 0)
+                    return false;
+                for (int j = path.length - 1; j > 0; --j)
+                {
+                    const Hop &from_hop = path.hops[j - 1];
+                    const Hop &to_hop = path.hops[j];
+                    std::atomic<uint64_t> &src = to->buckets[from_hop.bucket].slots[from_hop.slot];
+                    to->buckets[to_hop.bucket].slots[to_hop.slot].store(src.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    src.store(CK_EMPTY, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void CuckooHashTable::resize(CuckooBuckets *b)
+{
+    for (Stripe &s : stripes)
+    {
+        s.lock.lock();
+    }
+    if (current.load(std::memory_order_relaxed) == b)
+    {
+        // Every stripe is odd until the new array is published, lookups wait for it.
+        for (Stripe &s : stripes)
+        {
+            s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        size_t cap = b->capacity * 2;
+        CuckooBuckets *nb = new CuckooBuckets(cap);
+        while (!rehash(b, nb))
+        {
+            delete nb;
+            cap *= 2;
+            nb = new CuckooBuckets(cap);
+        }
+        current.store(nb, std::memory_order_release);
+        retired.push_back(b);
+
+        for (Stripe &s : stripes)
+        {
+            s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    }
+    for (Stripe &s : stripes)
+    {
+        s.lock.unlock();
+    }
+}
+
+bool CuckooHashTable::contains(unsigned int key)
+{
+    return get_value(key).first;
+}
+
+bool CuckooHashTable::insert(unsigned int key, unsigned int val)
+{
+    if (key == CK_EMPTY_KEY)
+    {
+        uint64_t expected = 0;
+        bool success = reserved.compare_exchange_strong(expected, (1ULL << 32) | val);
+        if (success)
+            size++;
+        return success;
+    }
+
+    uint64_t kv = packKeyValue(key, val);
+    size_t sa = stripe_first(key), sb = stripe_second(key);
+    while (true)
+    {
+        bool found = false;
+        std::atomic<uint64_t> *free_slot = nullptr;
+        size_t free_stripe = sa;
+        lock_pair(sa, sb);
+        // resize() needs every stripe, so the array can't change while we hold ours
+        CuckooBuckets *b = current.load(std::memory_order_relaxed);
+        size_t i1 = b->first(key), i2 = b->second(key);
+        for (size_t i : {i1, i2})
+        {
+            for (int s = 0; s < CuckooBucket::SLOTS; ++s)
+            {
+                uint64_t w = b->buckets[i].slots[s].load(std::memory_order_relaxed);
+                if ((w >> 32) == key)
+                    found = true;
+                else if (w == CK_EMPTY && free_slot == nullptr)
+                {
+                    free_slot = &b->buckets[i].slots[s];
+                    free_stripe = (i == i1) ? sa : sb;
+                }
+            }
+        }
+        if (!found && free_slot != nullptr)
+        {
+            SeqWriter w(stripes[free_stripe].seq);
+            free_slot->store(kv, std::memory_order_relaxed);
+        }
+        unlock_pair(sa, sb);
+
+        if (found)
+            return false;
+        if (free_slot != nullptr)
+        {
+            size++;
+            return true;
+        }
+        // Both buckets are full: make room along a displacement path and retry,
+        // or grow if there is none.
+        Path path = find_path(b, i1, i2);
+        if (path.length == 0)
+            resize(b);
+        else
+            move_path(b, path);
+    }
+}
+
+bool CuckooHashTable::remove(unsigned int key)
+{
+    if (key == CK_EMPTY_KEY)
+    {
+        bool success = (reserved.exchange(0) != 0);
+        if (success)
+            size--;
+        return success;
+    }
+
+    size_t sa = stripe_first(key), sb = stripe_second(key);
+    bool found = false;
+    lock_pair(sa, sb);
+    CuckooBuckets *b = current.load(std::memory_order_relaxed);
+    size_t i1 = b->first(key), i2 = b->second(key);
+    for (size_t i : {i1, i2})
+    {
+        for (int s = 0; s < CuckooBucket::SLOTS && !found; ++s)
+        {
+            std::atomic<uint64_t> &slot = b->buckets[i].slots[s];
+            if ((slot.load(std::memory_order_relaxed) >> 32) == key)
+            {
+                SeqWriter w(stripes[i == i1 ? sa : sb].seq);
+                slot.store(CK_EMPTY, std::memory_order_relaxed);
+                found = true;
+            }
+        }
+    }
+    unlock_pair(sa, sb);
+    if (found)
+        size--;
+    return found;
+}
+
+std::pair<bool, unsigned int> CuckooHashTable::get_value(unsigned int key)
+{
+    if (key == CK_EMPTY_KEY)
+    {
+        uint64_t r = reserved.load(std::memory_order_acquire);
+        return {r != 0, static_cast<uint32_t>(r)};
+    }
+
+    const std::atomic<uint64_t> &seq_a = stripes[stripe_first(key)].seq;
+    const std::atomic<uint64_t> &seq_b = stripes[stripe_second(key)].seq;
+    while (true)
+    {
+        uint64_t va = seq_a.load(std::memory_order_acquire);
+        uint64_t vb = seq_b.load(std::memory_order_acquire);
+        if ((va | vb) & 1)
+        {
+            // a writer is in one of the stripes
+            std::this_thread::yield();
+            continue;
+        }
+
+        // the array is loaded after the versions, so a finished resize is seen here
+        const CuckooBuckets *b = current.load(std::memory_order_acquire);
+        size_t i1 = b->first(key), i2 = b->second(key);
+        // both misses in flight at once, the second bucket is often needed
+        __builtin_prefetch(&b->buckets[i2]);
+        std::pair<bool, unsigned int> res = {false, 0};
+        for (size_t i : {i1, i2})
+        {
+            for (int s = 0; s < CuckooBucket::SLOTS && !res.first; ++s)
+            {
+                uint64_t w = b->buckets[i].slots[s].load(std::memory_order_relaxed);
+                if ((w >> 32) == key)
+                    res = {true, static_cast<uint32_t>(w)};
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_a.load(std::memory_order_relaxed) == va && seq_b.load(std::memory_order_relaxed) == vb)
+            return res;
+    }
+}
+
+#endif
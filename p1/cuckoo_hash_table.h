@@ -0,0 +1,114 @@
+// cuckoo_hash_table.h
+#ifndef CUCKOO_HASH_TABLE_H
+#define CUCKOO_HASH_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+#include "key_value.h"
+#include "hash_policy.h"
+#include "stripe_lock.h"
+
+// Bucketized cuckoo hashing: every key lives in one of two 4-way buckets, so a
+// lookup reads at most two half cache lines, and the table fills past 90% before
+// an insert runs out of displacement paths. Slots are packed (key, value) words,
+// and key CK_EMPTY_KEY marks a free slot, like in OAHashTable.
+static constexpr uint32_t CK_EMPTY_KEY = 0xFFFFFFFF;
+static const uint64_t CK_EMPTY = packKeyValue(CK_EMPTY_KEY, 0);
+
+struct alignas(32) CuckooBucket
+{
+    static constexpr int SLOTS = 4;
+    std::atomic<uint64_t> slots[SLOTS];
+
+    CuckooBucket()
+    {
+        for (int i = 0; i < SLOTS; ++i)
+            slots[i].store(CK_EMPTY, std::memory_order_relaxed);
+    }
+};
+
+struct CuckooBuckets
+{
+    size_t capacity; // buckets, a power of 2
+    size_t mask;
+    CuckooBucket *buckets;
+
+    CuckooBuckets(size_t cap) : capacity(cap), mask(cap - 1), buckets(new CuckooBucket[cap]) {}
+    ~CuckooBuckets() { delete[] buckets; }
+
+    // The two candidate buckets, from independent hashes. They may be the same bucket.
+    size_t first(uint32_t key) const { return FibonacciHash{}(key) & mask; }
+    size_t second(uint32_t key) const { return MurmurHash{}(key) & mask; }
+    // the other candidate of a key that sits in bucket i
+    size_t alt(uint32_t key, size_t i) const
+    {
+        size_t a = first(key);
+        return a != i ? a : second(key);
+    }
+};
+
+class CuckooHashTable
+{
+private:
+    static constexpr size_t NUM_STRIPES = 2048;
+    // Most buckets a displacement path goes through, and how many buckets the search may visit
+    static constexpr int MAX_PATH = 5;
+    static constexpr size_t MAX_VISITS = 512;
+
+    // One displacement: the key in buckets[bucket].slots[slot]. The last hop of a
+    // path is the free slot everything moves towards.
+    struct Hop
+    {
+        size_t bucket;
+        int slot;
+        uint32_t key;
+    };
+
+    struct Path
+    {
+        Hop hops[MAX_PATH];
+        int length = 0; // 0 if there is no path
+    };
+
+    std::atomic<CuckooBuckets *> current;
+    std::atomic<size_t> size;
+    std::atomic<uint64_t> reserved; // entry for CK_EMPTY_KEY: 0 if absent, (1 << 32 | val) otherwise
+    // Stripe of bucket i is i % NUM_STRIPES. Capacities are powers of 2 no smaller than
+    // that, so a key's stripes come from its hashes alone and never change on resize.
+    std::vector<Stripe> stripes;
+    // Readers may still be probing an old bucket array, so they are only freed in the destructor.
+    std::vector<CuckooBuckets *> retired;
+
+    static size_t stripe_first(uint32_t key) { return FibonacciHash{}(key) & (NUM_STRIPES - 1); }
+    static size_t stripe_second(uint32_t key) { return MurmurHash{}(key) & (NUM_STRIPES - 1); }
+
+    void lock_pair(size_t a, size_t b);
+    void unlock_pair(size_t a, size_t b);
+
+    // BFS from the key's two buckets to a bucket with a free slot.
+    static Path find_path(const CuckooBuckets *b, size_t i1, size_t i2);
+    // Moves the keys along path towards its free slot, one hop at a time under the
+    // locks of the two buckets involved. Gives up if another thread changed the path.
+    bool move_path(CuckooBuckets *b, const Path &path);
+    // Doubles the bucket array with every stripe locked, unless b is no longer current.
+    void resize(CuckooBuckets *b);
+    // Places every entry of from into to, single threaded. False if to is too small.
+    static bool rehash(const CuckooBuckets *from, CuckooBuckets *to);
+
+public:
+    CuckooHashTable(size_t cap);
+    ~CuckooHashTable();
+
+    bool contains(unsigned int key);
+
+    bool insert(unsigned int key, unsigned int val);
+
+    bool remove(unsigned int key);
+
+    std::pair<bool, unsigned int> get_value(unsigned int key);
+};
+
+#endif
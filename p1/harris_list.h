@@ -0,0 +1,122 @@
+// harris_list.h
+#ifndef HARRIS_LIST_H
+#define HARRIS_LIST_H
+
+#include <stdint.h>
+#include <atomic>
+#include "../PointerIntPair.h"
+#include "../epoch.h"
+
+// Lock-free sorted linked list (Harris, with Michael's unlinking during search).
+// A node is deleted logically by setting the mark bit packed into its next pointer,
+// the AtomicMarkableReference of Java, and unlinked by whichever traversal finds it marked.
+struct MarkedNode;
+using MarkedPtr = PointerIntPair<MarkedNode *, 1, bool>;
+
+struct MarkedNode
+{
+    uint64_t order; // the list is sorted by order, which is unique
+    uint32_t key;
+    std::atomic<uint32_t> value;
+    std::atomic<MarkedPtr> next;
+
+    MarkedNode(uint64_t o, uint32_t k, uint32_t v) : order(o), key(k), value(v), next(MarkedPtr(nullptr, false)) {}
+};
+
+// The operations take the link a list starts from, so a list can begin at any
+// node that is never deleted (a sentinel). They must run inside an EpochGuard:
+// unlinked nodes are handed to Epoch::retire, another thread may still be reading one.
+class HarrisList
+{
+public:
+    // Finds the first unmarked node with order >= o: curr is that node (or nullptr)
+    // and *prev is the unmarked link pointing to it. Unlinks the marked nodes it passes.
+    // Returns true if curr has order o.
+    static bool find(std::atomic<MarkedPtr> *head, uint64_t o, std::atomic<MarkedPtr> *&prev,
+                     MarkedNode *&curr)
+    {
+    retry:
+        prev = head;
+        curr = prev->load(std::memory_order_acquire).getPointer();
+        while (curr != nullptr)
+        {
+            MarkedPtr next = curr->next.load(std::memory_order_acquire);
+            if (prev->load(std::memory_order_acquire) != MarkedPtr(curr, false))
+                goto retry; // prev was deleted or changed under us
+            if (!next.getInt())
+            {
+                if (curr->order >= o)
+                    return curr->order == o;
+                prev = &curr->next;
+            }
+            else
+            {
+                MarkedPtr expected(curr, false);
+                if (!prev->compare_exchange_strong(expected, MarkedPtr(next.getPointer(), false),
+                                                   std::memory_order_acq_rel, std::memory_order_acquire))
+                    goto retry;
+                Epoch::retire(curr);
+            }
+            curr = next.getPointer();
+        }
+        return false;
+    }
+
+    // Links node in, unless there already is a node with its order. Returns the node
+    // that is in the list: node itself, or the one that was there before.
+    static MarkedNode *insert(std::atomic<MarkedPtr> *head, MarkedNode *node)
+    {
+        std::atomic<MarkedPtr> *prev;
+        MarkedNode *curr;
+        while (true)
+        {
+            if (find(head, node->order, prev, curr))
+                return curr;
+            node->next.store(MarkedPtr(curr, false), std::memory_order_relaxed);
+            MarkedPtr expected(curr, false);
+            if (prev->compare_exchange_strong(expected, MarkedPtr(node, false),
+                                              std::memory_order_acq_rel, std::memory_order_relaxed))
+                return node;
+        }
+    }
+
+    // Marks the node with order o, then tries to unlink it. Returns false if there was none.
+    static bool remove(std::atomic<MarkedPtr> *head, uint64_t o)
+    {
+        std::atomic<MarkedPtr> *prev;
+        MarkedNode *curr;
+        while (true)
+        {
+            if (!find(head, o, prev, curr))
+                return false;
+            MarkedPtr next = curr->next.load(std::memory_order_acquire);
+            // whoever sets the mark owns the removal
+            if (next.getInt() ||
+                !curr->next.compare_exchange_strong(next, MarkedPtr(next.getPointer(), true),
+                                                    std::memory_order_acq_rel, std::memory_order_relaxed))
+                continue;
+            MarkedPtr expected(curr, false);
+            if (prev->compare_exchange_strong(expected, MarkedPtr(next.getPointer(), false),
+                                              std::memory_order_acq_rel, std::memory_order_relaxed))
+                Epoch::retire(curr);
+            else
+                find(head, o, prev, curr); // unlinks it
+            return true;
+        }
+    }
+
+    // Wait-free lookup, it never writes. Returns nullptr if there is no unmarked node with order o.
+    static MarkedNode *lookup(const std::atomic<MarkedPtr> *head, uint64_t o)
+    {
+        MarkedNode *curr = head->load(std::memory_order_acquire).getPointer();
+        while (curr != nullptr && curr->order < o)
+        {
+            curr = curr->next.load(std::memory_order_acquire).getPointer();
+        }
+        if (curr == nullptr || curr->order != o || curr->next.load(std::memory_order_acquire).getInt())
+            return nullptr;
+        return curr;
+    }
+};
+
+#endif
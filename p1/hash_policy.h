@@ -0,0 +1,66 @@
+// hash_policy.h
+#ifndef HASH_POLICY_H
+#define HASH_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+// Hash policies for BasicHashTable. Capacities are powers of 2 and a key's bucket
+// and stripe are the low bits of its hash, so a policy has to mix the key into them.
+
+// Costs nothing, fine for random keys. Strided keys (multiples of 2^n) share few buckets.
+struct IdentityHash
+{
+    size_t operator()(uint32_t key) const
+    {
+        return key;
+    }
+};
+
+// Multiplicative hashing by 2^64 / golden ratio. The upper half of the product depends
+// on every key bit, so sequential and strided keys spread out.
+struct FibonacciHash
+{
+    size_t operator()(uint32_t key) const
+    {
+        return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> 32;
+    }
+};
+
+// murmur3 finalizer, every key bit flips every hash bit with probability about 1/2.
+struct MurmurHash
+{
+    size_t operator()(uint32_t key) const
+    {
+        key ^= key >> 16;
+        key *= 0x85EBCA6B;
+        key ^= key >> 13;
+        key *= 0xC2B2AE35;
+        key ^= key >> 16;
+        return key;
+    }
+};
+
+// CRC32C of the key, a single instruction with SSE4.2. Builds without it compute
+// the same value bit by bit, which is slow.
+struct Crc32Hash
+{
+    size_t operator()(uint32_t key) const
+    {
+#ifdef __SSE4_2__
+        return _mm_crc32_u32(0xFFFFFFFF, key);
+#else
+        uint32_t crc = 0xFFFFFFFF ^ key;
+        for (int i = 0; i < 32; ++i)
+        {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0u - (crc & 1)));
+        }
+        return crc;
+#endif
+    }
+};
+
+#endif
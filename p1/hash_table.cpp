@@ -3,109 +3,769 @@
 #include <iostream>
 #include <pthread.h>
 #include <vector>
+#include <algorithm>
+#include <barrier>
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "snapshot.h"
+#include "../epoch.h"
 
-void HashTable::resize()
+// Counting sort of n keys by stripe: the indices of stripe s end up in
+// order[start[s] .. start[s + 1]), still in input order.
+template <typename StripeOf>
+static void group_by_stripe(size_t n, size_t num_stripes, StripeOf stripe_of,
+                            std::vector<uint32_t> &start, std::vector<uint32_t> &order)
 {
-    size_t old_cap = table.capacity.load();
+    start.assign(num_stripes + 1, 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        start[stripe_of(i) + 1]++;
+    }
+    for (size_t s = 0; s < num_stripes; ++s)
+    {
+        start[s + 1] += start[s];
+    }
+    std::vector<uint32_t> pos(start.begin(), start.end() - 1);
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        order[pos[stripe_of(i)]++] = i;
+    }
+}
+
+template <typename Hash>
+size_t BasicHashTable<Hash>::wanted_capacity() const
+{
+    // Insert counts its entry after unlocking, so a racing remove can take the count
+    // below zero for a moment. The shards that aren't folded yet are left out.
+    size_t size = std::max<int64_t>(table.size.approx(), 0);
+    size_t cap = table.capacity.load();
+    if (policy.too_full(size, cap))
+        return policy.target_buckets(size);
+    size_t floor = min_capacity.load();
+    if (cap > floor && policy.too_empty(size, cap))
+        return std::max(policy.target_buckets(size), floor);
+    return cap;
+}
 
-    // acquire every lock
-    for (auto &lck : locks)
+template <typename Hash>
+bool BasicHashTable<Hash>::resize(size_t new_cap)
+{
+    bool expected = false;
+    if (!resizing.compare_exchange_strong(expected, true))
     {
-        lck.lock();
+        // Someone is already resizing it
+        return false;
     }
+    if (new_cap == 0)
+        new_cap = wanted_capacity();
+    BucketArray *old_tbl = table.current.load();
+    if (new_cap == old_tbl->capacity)
+    {
+        resizing.store(false);
+        return true;
+    }
+
+    // Only allocate the next generation here, the entries are moved by
+    // migrate_bucket() as operations touch them or help out.
+    BucketArray *new_tbl = new BucketArray(new_cap, old_tbl);
+    set_capacity(new_cap);
+    table.current.store(new_tbl, std::memory_order_release);
+    return true;
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::migrate_bucket(BucketArray *b, size_t i)
+{
+    BucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+    if (old_tbl == nullptr || old_tbl->migrated[i])
+        return;
 
-    if (old_cap != table.capacity.load())
+    SeqWriter w(stripes[i & (lock_length - 1)].seq);
+
+    auto move_entries = [&](List &src)
     {
-        // Someone already resized it
-        for (auto &lck : locks)
+        for (Bucket *line = &src.head; line != nullptr; line = line->next.load(std::memory_order_relaxed))
         {
-            lck.unlock();
+            uint32_t n = line->count.load(std::memory_order_relaxed);
+            for (uint32_t s = 0; s < n; ++s)
+            {
+                uint32_t key = line->key_at(s);
+                b->lists[Table<Hash>::hash(key, b->capacity)].append(key, line->values[s].load(std::memory_order_relaxed), table.pool);
+            }
         }
-        return;
+        src.clear(table.pool);
+    };
+
+    // Buckets that map to each other have the same low bits, so they share the stripe.
+    size_t moved = 1;
+    if (b->capacity > old_tbl->capacity)
+    {
+        // Growing: bucket i spreads over i, i + old_cap, i + 2 * old_cap, ...
+        // which nobody has touched yet.
+        for (size_t j = i; j < b->capacity; j += old_tbl->capacity)
+        {
+            new (&b->lists[j]) List();
+        }
+        move_entries(old_tbl->lists[i]);
+        // release: a lookup that sees the flag also sees the constructed buckets
+        std::atomic_ref<char>(old_tbl->migrated[i]).store(1, std::memory_order_release);
+    }
+    else
+    {
+        // Shrinking: new bucket j gathers j, j + new_cap, j + 2 * new_cap, ... of the
+        // old generation, which all move together.
+        size_t j = i & (b->capacity - 1);
+        new (&b->lists[j]) List();
+        for (size_t k = j; k < old_tbl->capacity; k += b->capacity)
+        {
+            move_entries(old_tbl->lists[k]);
+        }
+        for (size_t k = j; k < old_tbl->capacity; k += b->capacity)
+        {
+            std::atomic_ref<char>(old_tbl->migrated[k]).store(1, std::memory_order_release);
+        }
+        moved = old_tbl->capacity / b->capacity;
     }
 
-    // resize
-    size_t new_cap = old_cap * 2;
-    std::vector<List *> new_tbl(new_cap);
-    for (size_t i = 0; i < new_cap; ++i)
+    if (b->migrate_done.fetch_add(moved) + moved == old_tbl->capacity)
     {
-        new_tbl[i] = new List();
+        // last bucket, the old generation is drained
+        b->prev.store(nullptr, std::memory_order_release);
+        // lock-free readers and the other stripes may still be looking at it
+        Epoch::retire(old_tbl, old_tbl->capacity * (sizeof(List) + sizeof(char)));
+        resizing.store(false, std::memory_order_release);
     }
+}
 
-    // new hash function
-    // size_t new_hash(unsigned int key) const
-    // {
-    //     return key % new_cap;
-    // }
+template <typename Hash>
+bool BasicHashTable<Hash>::help_migrate()
+{
+    // only a hint, so that writers don't pin when there is nothing to move. A resize
+    // that starts right after is helped by the next call.
+    if (!resizing.load(std::memory_order_acquire))
+        return false;
+    EpochGuard guard;
+    BucketArray *b = table.current.load(std::memory_order_acquire);
+    BucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+    if (old_tbl == nullptr)
+        return false;
 
-    // Rehash entries
-    for (size_t i = 0; i < old_cap; ++i)
+    for (size_t n = 0; n < MIGRATE_CHUNK; ++n)
     {
-        Node *curr = table.tbl[i]->top;
-        while (curr != nullptr)
-        {
-            size_t new_idx = curr->key % new_cap; // TODO: Change it to use the function to compute hash.
-            new_tbl[new_idx]->insert(curr->key, curr->value);
-            curr = curr->next;
-        }
+        size_t i = b->migrate_next.fetch_add(1);
+        if (i >= old_tbl->capacity)
+            return false;
+        std::lock_guard<StripeLock> lock(stripes[i & (lock_length - 1)].lock);
+        migrate_bucket(b, i);
+    }
+    return true;
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::finish_resize()
+{
+    while (resizing.load(std::memory_order_acquire))
+    {
+        // the last buckets are being moved by others
+        if (!help_migrate())
+            std::this_thread::yield();
+    }
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::reserve(size_t n)
+{
+    size_t want = std::max(policy.min_buckets(n), lock_length);
+    size_t floor = min_capacity.load();
+    while (floor < want && !min_capacity.compare_exchange_weak(floor, want))
+    {
+    }
+    grow_to(want);
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::grow_to(size_t buckets)
+{
+    while (true)
+    {
+        finish_resize();
+        if (table.capacity.load() >= buckets)
+            return;
+        resize(buckets);
     }
+}
 
-    for (List *list : table.tbl)
+template <typename Hash>
+void BasicHashTable<Hash>::shrink_to_fit()
+{
+    min_capacity.store(lock_length);
+    while (true)
     {
-        delete list;
+        finish_resize();
+        size_t want = std::max(policy.min_buckets(size()), lock_length);
+        if (table.capacity.load() <= want)
+            break;
+        resize(want);
     }
-    table.tbl = new_tbl;
-    table.capacity.store(new_cap);
+    // the drained generations are retired, give their memory back now
+    Epoch::synchronize();
+}
 
-    // Release all locks
-    for (auto &mtx : locks)
+template <typename Hash>
+List *BasicHashTable<Hash>::bucket_for(unsigned int key)
+{
+    // The stripe lock keeps b from being drained, but the last bucket of the old
+    // generation may be moved under another stripe and retire it meanwhile.
+    BucketArray *b = table.current.load(std::memory_order_acquire);
+    if (b->prev.load(std::memory_order_relaxed) != nullptr)
     {
-        mtx.unlock();
+        EpochGuard guard;
+        BucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+        if (old_tbl != nullptr)
+            migrate_bucket(b, Table<Hash>::hash(key, old_tbl->capacity));
     }
+    return &b->lists[Table<Hash>::hash(key, b->capacity)];
+}
+
+template <typename Hash>
+std::pair<bool, unsigned int> BasicHashTable<Hash>::read_optimistic(unsigned int key)
+{
+    const std::atomic<uint64_t> &seq = stripes[lock_index(key)].seq;
+    // both generations may be retired by a resize while they are read
+    EpochGuard guard;
+    while (true)
+    {
+        uint64_t ver = seq.load(std::memory_order_acquire);
+        if (ver & 1)
+        {
+            // a writer is in the stripe
+            std::this_thread::yield();
+            continue;
+        }
+
+        BucketArray *b = table.current.load(std::memory_order_acquire);
+        BucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+        const List *l = nullptr;
+        if (old_tbl != nullptr)
+        {
+            size_t i = Table<Hash>::hash(key, old_tbl->capacity);
+            if (!std::atomic_ref<char>(old_tbl->migrated[i]).load(std::memory_order_acquire))
+                l = &old_tbl->lists[i];
+        }
+        if (l == nullptr)
+            l = &b->lists[Table<Hash>::hash(key, b->capacity)];
+
+        // Overflow lines are never freed while the table is alive, only recycled,
+        // so the walk is memory safe. It stops as soon as the version moves.
+        std::pair<bool, unsigned int> res = {false, 0};
+        const Bucket *line = &l->head;
+        while (line != nullptr && seq.load(std::memory_order_relaxed) == ver)
+        {
+            unsigned int m = line->match(key);
+            if (m != 0)
+            {
+                res = {true, line->values[__builtin_ctz(m)].load(std::memory_order_relaxed)};
+                break;
+            }
+            line = line->next.load(std::memory_order_acquire);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == ver)
+            return res;
+    }
+}
+
+template <typename Hash>
+const List *BasicHashTable<Hash>::prefetch_bucket(unsigned int key) const
+{
+    __builtin_prefetch(&stripes[lock_index(key)].seq);
+    BucketArray *b = table.current.load(std::memory_order_acquire);
+    const List *l = &b->lists[Table<Hash>::hash(key, b->capacity)];
+    __builtin_prefetch(l);
+    BucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+    if (old_tbl == nullptr)
+        return l;
+    size_t i = Table<Hash>::hash(key, old_tbl->capacity);
+    __builtin_prefetch(&old_tbl->migrated[i]);
+    __builtin_prefetch(&old_tbl->lists[i]);
+    // the new bucket may not be constructed yet, nothing to follow
+    return nullptr;
 }
 
-bool HashTable::contains(unsigned int key)
+template <typename Hash>
+bool BasicHashTable<Hash>::contains(unsigned int key)
 {
-    size_t idx = table.hash(key);
-    std::lock_guard<std::recursive_mutex> lock(locks[idx % lock_length]);
-    return table.tbl[idx]->contains(key);
+    return read_optimistic(key).first;
 }
 
-bool HashTable::insert(unsigned int key, unsigned int val)
+template <typename Hash>
+bool BasicHashTable<Hash>::insert(unsigned int key, unsigned int val)
 {
-    size_t idx = table.hash(key);
-    locks[idx % lock_length].lock();
-    bool success = table.tbl[idx]->insert(key, val);
+    size_t lck = lock_index(key);
+    stripes[lck].lock.lock();
+    List *l = bucket_for(key);
+    bool success;
+    {
+        SeqWriter w(stripes[lck].seq);
+        success = l->insert(key, val, table.pool);
+    }
     // release the lock first, before contending for resize
-    locks[idx % lock_length].unlock();
+    stripes[lck].lock.unlock();
     if (success)
     {
-        table.size++;
-        if (needs_resize())
+        added(1);
+    }
+    help_migrate();
+    return success;
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::copy_stripe(size_t s, std::vector<KeyValue> &out)
+{
+    std::lock_guard<StripeLock> lock(stripes[s].lock);
+    BucketArray *b = table.current.load(std::memory_order_acquire);
+    if (b->prev.load(std::memory_order_relaxed) != nullptr)
+    {
+        EpochGuard guard;
+        BucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+        for (size_t i = s; old_tbl != nullptr && i < old_tbl->capacity; i += lock_length)
         {
-            resize();
-            return success;
+            migrate_bucket(b, i);
         }
     }
-    return success;
+    for (size_t i = s; i < b->capacity; i += lock_length)
+    {
+        for (const Bucket *line = &b->lists[i].head; line != nullptr; line = line->next.load(std::memory_order_relaxed))
+        {
+            uint32_t n = line->count.load(std::memory_order_relaxed);
+            for (uint32_t k = 0; k < n; ++k)
+            {
+                out.push_back({line->key_at(k), line->values[k].load(std::memory_order_relaxed)});
+            }
+        }
+    }
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::added(size_t n)
+{
+    // the policy only needs a look when the total moved
+    if (table.size.add(n) && needs_resize())
+    {
+        resize();
+    }
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::removed(size_t n)
+{
+    if (table.size.add(-static_cast<int64_t>(n)) && needs_resize())
+    {
+        resize();
+    }
 }
 
-bool HashTable::remove(unsigned int key)
+template <typename Hash>
+bool BasicHashTable<Hash>::remove(unsigned int key)
 {
-    size_t idx = table.hash(key);
-    std::lock_guard<std::recursive_mutex> lock(locks[idx % lock_length]);
-    bool result = table.tbl[idx]->del(key);
+    bool result;
+    {
+        size_t lck = lock_index(key);
+        std::lock_guard<StripeLock> lock(stripes[lck].lock);
+        List *l = bucket_for(key);
+        SeqWriter w(stripes[lck].seq);
+        result = l->del(key, table.pool);
+    }
     if (result)
-        table.size--;
+        removed(1);
+    help_migrate();
     return result;
 }
 
-std::pair<bool, unsigned int> HashTable::get_value(unsigned int key)
+template <typename Hash>
+std::pair<bool, unsigned int> BasicHashTable<Hash>::get_value(unsigned int key)
 {
-    size_t idx = table.hash(key);
-    std::lock_guard<std::recursive_mutex> lock(locks[idx % lock_length]);
     // pair<bool,unsigned int> can be used for query of different type
-    return table.tbl[idx]->getval(key);
+    return read_optimistic(key);
+}
+
+template <typename Hash>
+unsigned int BasicHashTable<Hash>::fetch_add(unsigned int key, unsigned int delta)
+{
+    unsigned int before = 0;
+    upsert(key, [&](bool, uint32_t &val)
+           { before = val; val += delta; });
+    return before;
+}
+
+template <typename Hash>
+bool BasicHashTable<Hash>::insert_or_assign(unsigned int key, unsigned int val)
+{
+    return upsert(key, [val](bool, uint32_t &v)
+                  { v = val; });
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::insert_batch(const KeyValue *kv_pairs, size_t n, bool *result)
+{
+    std::vector<uint32_t> start, order;
+    size_t chunk = BATCH_PER_STRIPE * lock_length;
+    for (size_t base = 0; base < n; base += chunk)
+    {
+        const KeyValue *kvs = kv_pairs + base;
+        size_t m = std::min(chunk, n - base);
+        group_by_stripe(m, lock_length, [&](size_t i)
+                        { return lock_index(kvs[i].key); }, start, order);
+
+        for (size_t s = 0; s < lock_length; ++s)
+        {
+            if (start[s] == start[s + 1])
+                continue;
+            size_t inserted = 0;
+            {
+                std::lock_guard<StripeLock> lock(stripes[s].lock);
+                for (uint32_t k = start[s]; k < start[s + 1]; ++k)
+                {
+                    uint32_t i = order[k];
+                    List *l = bucket_for(kvs[i].key);
+                    SeqWriter w(stripes[s].seq);
+                    result[base + i] = l->insert(kvs[i].key, kvs[i].value, table.pool);
+                    inserted += result[base + i];
+                }
+            }
+            if (inserted > 0)
+            {
+                added(inserted);
+            }
+            help_migrate();
+        }
+    }
+}
+
+template <typename Hash>
+size_t BasicHashTable<Hash>::bulk_load(const KeyValue *kv_pairs, size_t n, size_t threads, bool *result)
+{
+    if (n == 0)
+        return 0;
+    assert(n <= UINT32_MAX);
+    threads = std::clamp<size_t>(threads, 1, n);
+
+    // no resize while loading, the buckets go straight to their final size
+    grow_to(std::max(policy.min_buckets(size() + n), lock_length));
+    size_t cap = table.capacity.load();
+    size_t buckets_per_stripe = cap / lock_length;
+    int stripe_bits = __builtin_ctzll(lock_length);
+
+    // A pair copied next to the others of its stripe, and where it came from.
+    struct Staged
+    {
+        uint32_t key;
+        uint32_t value;
+        uint32_t index;
+    };
+
+    // Counting sort by stripe, every thread counting and then placing its own slice.
+    // count[w * lock_length + s] turns from a count into where slice w's pairs of stripe s go.
+    std::vector<uint32_t> count(threads * lock_length, 0);
+    std::vector<uint32_t> start(lock_length + 1);
+    std::vector<Staged> staged(n);
+    std::barrier counted(static_cast<ptrdiff_t>(threads), [&]() noexcept
+                         {
+        // stripe major, then slice: each stripe's pairs stay in input order
+        uint32_t pos = 0;
+        for (size_t s = 0; s < lock_length; ++s)
+        {
+            start[s] = pos;
+            for (size_t w = 0; w < threads; ++w)
+            {
+                uint32_t c = count[w * lock_length + s];
+                count[w * lock_length + s] = pos;
+                pos += c;
+            }
+        }
+        start[lock_length] = pos; });
+    std::barrier placed(static_cast<ptrdiff_t>(threads));
+    std::atomic<size_t> next_stripe(0);
+    std::atomic<size_t> total(0);
+
+    auto work = [&](size_t w)
+    {
+        size_t lo = n * w / threads, hi = n * (w + 1) / threads;
+        uint32_t *my_count = &count[w * lock_length];
+        for (size_t i = lo; i < hi; ++i)
+        {
+            my_count[lock_index(kv_pairs[i].key)]++;
+        }
+        counted.arrive_and_wait();
+        for (size_t i = lo; i < hi; ++i)
+        {
+            const KeyValue &kv = kv_pairs[i];
+            staged[my_count[lock_index(kv.key)]++] = {kv.key, kv.value, static_cast<uint32_t>(i)};
+        }
+        placed.arrive_and_wait();
+
+        // Whole stripes, each locked once by the one thread that fills it. A stripe's
+        // pairs are sorted by bucket first, again stably, so its buckets are filled
+        // in address order instead of at random.
+        std::vector<uint32_t> bucket_start(buckets_per_stripe + 1);
+        std::vector<Staged> sorted;
+        size_t s;
+        while ((s = next_stripe.fetch_add(1)) < lock_length)
+        {
+            if (start[s] == start[s + 1])
+                continue;
+            auto bucket_of = [&](uint32_t key)
+            { return Table<Hash>::hash(key, cap) >> stripe_bits; };
+            std::fill(bucket_start.begin(), bucket_start.end(), 0);
+            for (uint32_t k = start[s]; k < start[s + 1]; ++k)
+            {
+                bucket_start[bucket_of(staged[k].key) + 1]++;
+            }
+            for (size_t j = 0; j < buckets_per_stripe; ++j)
+            {
+                bucket_start[j + 1] += bucket_start[j];
+            }
+            sorted.resize(start[s + 1] - start[s]);
+            for (uint32_t k = start[s]; k < start[s + 1]; ++k)
+            {
+                sorted[bucket_start[bucket_of(staged[k].key)]++] = staged[k];
+            }
+
+            size_t inserted = 0;
+            {
+                std::lock_guard<StripeLock> lock(stripes[s].lock);
+                for (const Staged &p : sorted)
+                {
+                    List *l = bucket_for(p.key);
+                    SeqWriter sw(stripes[s].seq);
+                    bool ok = l->insert(p.key, p.value, table.pool);
+                    if (result != nullptr)
+                        result[p.index] = ok;
+                    inserted += ok;
+                }
+            }
+            if (inserted > 0)
+            {
+                added(inserted);
+                total += inserted;
+            }
+            help_migrate();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t w = 1; w < threads; ++w)
+    {
+        workers.emplace_back(work, w);
+    }
+    work(0);
+    for (std::thread &t : workers)
+    {
+        t.join();
+    }
+    return total.load();
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::remove_batch(const uint32_t *keys, size_t n, bool *result)
+{
+    std::vector<uint32_t> start, order;
+    size_t chunk = BATCH_PER_STRIPE * lock_length;
+    for (size_t base = 0; base < n; base += chunk)
+    {
+        const uint32_t *ks = keys + base;
+        size_t m = std::min(chunk, n - base);
+        group_by_stripe(m, lock_length, [&](size_t i)
+                        { return lock_index(ks[i]); }, start, order);
+
+        for (size_t s = 0; s < lock_length; ++s)
+        {
+            if (start[s] == start[s + 1])
+                continue;
+            size_t deleted = 0;
+            {
+                std::lock_guard<StripeLock> lock(stripes[s].lock);
+                for (uint32_t k = start[s]; k < start[s + 1]; ++k)
+                {
+                    uint32_t i = order[k];
+                    List *l = bucket_for(ks[i]);
+                    SeqWriter w(stripes[s].seq);
+                    result[base + i] = l->del(ks[i], table.pool);
+                    deleted += result[base + i];
+                }
+            }
+            if (deleted > 0)
+                removed(deleted);
+            help_migrate();
+        }
+    }
+}
+
+template <typename Hash>
+void BasicHashTable<Hash>::get_value_batch(const uint32_t *keys, size_t n, uint32_t *values, bool *found)
+{
+    const List *group[PREFETCH_GROUP];
+    for (size_t base = 0; base < n; base += PREFETCH_GROUP)
+    {
+        size_t m = std::min(PREFETCH_GROUP, n - base);
+        // the buckets of group stay allocated until the group is done
+        EpochGuard guard;
+        // 1. bucket heads and stripe versions of the whole group
+        for (size_t i = 0; i < m; ++i)
+        {
+            group[i] = prefetch_bucket(keys[base + i]);
+        }
+        // 2. first overflow line, the heads requested above have arrived by now
+        for (size_t i = 0; i < m; ++i)
+        {
+            if (group[i] == nullptr)
+                continue;
+            const Bucket *next = group[i]->head.next.load(std::memory_order_relaxed);
+            if (next != nullptr)
+                __builtin_prefetch(next);
+        }
+        // 3. the lookups themselves, mostly against cached lines
+        for (size_t i = 0; i < m; ++i)
+        {
+            std::pair<bool, unsigned int> res = read_optimistic(keys[base + i]);
+            values[base + i] = res.second;
+            if (found != nullptr)
+                found[base + i] = res.first;
+        }
+    }
+}
+
+template <typename Hash>
+bool BasicHashTable<Hash>::save(const char *path)
+{
+    // The file keeps the bucket count of the moment, a resize meanwhile changes nothing:
+    // the entries are bucketed again as they are written.
+    size_t cap = table.capacity.load();
+    size_t buckets_per_stripe = cap / lock_length;
+    int stripe_bits = __builtin_ctzll(lock_length);
+
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE *fout = fopen(tmp_path.c_str(), "wb");
+    if (fout == nullptr)
+    {
+        std::string error_msg = "Unable to open file: " + tmp_path;
+        perror(error_msg.c_str());
+        return false;
+    }
+
+    // Entries first, after room for the header and the offsets, which are only known at the end.
+    std::vector<uint64_t> offsets(cap + 1);
+    size_t entries_at = sizeof(SnapshotHeader) + offsets.size() * sizeof(uint64_t);
+    bool ok = fseeko(fout, entries_at, SEEK_SET) == 0;
+    uint64_t written = 0;
+    std::vector<KeyValue> entries, sorted;
+    std::vector<uint32_t> bucket_start(buckets_per_stripe + 1);
+    for (size_t s = 0; s < lock_length && ok; ++s)
+    {
+        entries.clear();
+        copy_stripe(s, entries);
+        auto bucket_of = [&](uint32_t key)
+        { return Table<Hash>::hash(key, cap) >> stripe_bits; };
+        std::fill(bucket_start.begin(), bucket_start.end(), 0);
+        for (const KeyValue &kv : entries)
+        {
+            bucket_start[bucket_of(kv.key) + 1]++;
+        }
+        for (size_t j = 0; j < buckets_per_stripe; ++j)
+        {
+            offsets[s * buckets_per_stripe + j] = written + bucket_start[j];
+            bucket_start[j + 1] += bucket_start[j];
+        }
+        sorted.resize(entries.size());
+        for (const KeyValue &kv : entries)
+        {
+            sorted[bucket_start[bucket_of(kv.key)]++] = kv;
+        }
+        ok = fwrite(sorted.data(), sizeof(KeyValue), sorted.size(), fout) == sorted.size();
+        written += sorted.size();
+    }
+    offsets[cap] = written;
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.hash_check = snapshot_hash_check<Hash>();
+    header.capacity = cap;
+    header.stripes = lock_length;
+    header.size = written;
+    ok = ok && fseeko(fout, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, fout) == 1 &&
+         fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), fout) == offsets.size();
+    ok = (fclose(fout) == 0) && ok;
+    if (ok)
+        ok = rename(tmp_path.c_str(), path) == 0;
+    if (!ok)
+    {
+        std::string error_msg = std::string("Unable to write snapshot: ") + path;
+        perror(error_msg.c_str());
+        ::remove(tmp_path.c_str());
+    }
+    return ok;
 }
 
-#endif
\ No newline at end of file
+template <typename Hash>
+BasicHashTable<Hash> *BasicHashTable<Hash>::load(const char *path, size_t threads, size_t num_stripes,
+                                                 ResizePolicy resize_policy)
+{
+    SnapshotMapping map;
+    if (!map.open(path, snapshot_hash_check<Hash>()))
+        return nullptr;
+    size_t cap = map.header->capacity;
+    size_t file_stripes = map.header->stripes;
+    size_t buckets_per_stripe = cap / file_stripes;
+
+    // Exactly cap buckets: min_buckets() of cap * max_load entries is cap, as long as
+    // there are no more stripes than that.
+    num_stripes = std::min(round_up_pow2(num_stripes != 0 ? num_stripes : default_stripes()), cap);
+    BasicHashTable *ht = new BasicHashTable(cap * resize_policy.max_load, num_stripes, resize_policy);
+    assert(ht->table.capacity.load() == cap);
+    madvise(map.base, map.length, MADV_SEQUENTIAL);
+
+    // Nobody else sees the table yet and every bucket is filled by one thread, so no
+    // locks. Threads take contiguous runs of the file, which is read in order.
+    BucketArray *b = ht->table.current.load();
+    size_t positions = cap;
+    threads = std::clamp<size_t>(threads, 1, positions);
+    auto work = [&](size_t w)
+    {
+        size_t lo = positions * w / threads, hi = positions * (w + 1) / threads;
+        for (size_t p = lo; p < hi; ++p)
+        {
+            List &l = b->lists[(p % buckets_per_stripe) * file_stripes + p / buckets_per_stripe];
+            for (uint64_t k = map.offsets[p]; k < map.offsets[p + 1]; ++k)
+            {
+                l.append(map.entries[k].key, map.entries[k].value, ht->table.pool);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t w = 1; w < threads; ++w)
+    {
+        workers.emplace_back(work, w);
+    }
+    work(0);
+    for (std::thread &t : workers)
+    {
+        t.join();
+    }
+
+    ht->table.size.add(map.header->size);
+    map.close();
+    return ht;
+}
+
+template class BasicHashTable<IdentityHash>;
+template class BasicHashTable<FibonacciHash>;
+template class BasicHashTable<MurmurHash>;
+template class BasicHashTable<Crc32Hash>;
+
+#endif
@@ -1,4 +1,6 @@
 // hash_table.h
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -10,193 +12,409 @@
 #include <thread>
 #include <mutex>
 #include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdlib.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "../slab_pool.h"
+#include "key_value.h"
+#include "hash_policy.h"
+#include "resize_policy.h"
+#include "sharded_counter.h"
+#include "stripe_lock.h"
 
-struct Node
+// One cache line of a bucket: up to SLOTS entries and a link to an overflow line,
+// which only exists once this one is full. Fields are atomics because lookups read
+// them without the stripe lock (see BasicHashTable::read_optimistic); writers hold the
+// lock and use relaxed accesses.
+struct alignas(64) Bucket
 {
-    unsigned int key;
-    unsigned int value;
-    Node *next;
+    static constexpr int SLOTS = 6;
 
-    Node(unsigned int k, unsigned int v, Node *n = nullptr) : key(k), value(v), next(n) {}
+    std::atomic<uint64_t> key_pairs[SLOTS / 2]; // two keys per word, so they load straight into a vector
+    std::atomic<uint32_t> values[SLOTS];
+    std::atomic<uint32_t> count;
+    std::atomic<Bucket *> next;
+
+    Bucket() : count(0), next(nullptr)
+    {
+        for (int i = 0; i < SLOTS / 2; ++i)
+            key_pairs[i].store(0, std::memory_order_relaxed);
+        for (int i = 0; i < SLOTS; ++i)
+            values[i].store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t key_at(int i) const
+    {
+        return key_pairs[i / 2].load(std::memory_order_relaxed) >> (32 * (i & 1));
+    }
+
+    void set(int i, uint32_t key, uint32_t val)
+    {
+        uint64_t w = key_pairs[i / 2].load(std::memory_order_relaxed);
+        int shift = 32 * (i & 1);
+        w = (w & ~(0xFFFFFFFFULL << shift)) | (static_cast<uint64_t>(key) << shift);
+        key_pairs[i / 2].store(w, std::memory_order_relaxed);
+        values[i].store(val, std::memory_order_relaxed);
+    }
+
+    // bit i is set if slot i holds key
+    unsigned int match(uint32_t key) const
+    {
+        uint64_t k01 = key_pairs[0].load(std::memory_order_relaxed);
+        uint64_t k23 = key_pairs[1].load(std::memory_order_relaxed);
+        uint64_t k45 = key_pairs[2].load(std::memory_order_relaxed);
+        unsigned int n = count.load(std::memory_order_relaxed);
+#ifdef __SSE2__
+        __m128i needle = _mm_set1_epi32(static_cast<int>(key));
+        __m128i lo = _mm_set_epi64x(static_cast<long long>(k23), static_cast<long long>(k01));
+        __m128i hi = _mm_set_epi64x(0, static_cast<long long>(k45));
+        unsigned int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lo, needle))) |
+                         _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(hi, needle))) << 4;
+#else
+        uint64_t words[3] = {k01, k23, k45};
+        unsigned int m = 0;
+        for (int i = 0; i < SLOTS; ++i)
+        {
+            if (static_cast<uint32_t>(words[i / 2] >> (32 * (i & 1))) == key)
+                m |= 1u << i;
+        }
+#endif
+        return m & ((1u << n) - 1);
+    }
 };
+static_assert(sizeof(Bucket) == 64, "Bucket must fill exactly one cache line");
 
-// euivalent of atomicmarkable reference
-// atomic<PointerIntPair<V *, 1>>::compare_exchange_weak(PointerIntPair<V *, 1>& expectedPair, PointerIntPair<V *, 1> newPair)
+// Overflow lines come from the table's pool, which tables may share. A line that is given
+// back stays a Bucket until the last table of its pool is destroyed, an optimistic
+// reader may still be looking at it.
+using LinePool = SlabPool<Bucket>;
+
+inline Bucket *take_line(LinePool &pool)
+{
+    Bucket *line = pool.alloc();
+    line->count.store(0, std::memory_order_relaxed);
+    line->next.store(nullptr, std::memory_order_relaxed);
+    return line;
+}
+
+// The lock-free bucket list, with atomic<PointerIntPair<V *, 1>> as the atomic markable
+// reference, is HarrisList (harris_list.h), used by LockFreeHashTable.
+//
+// A bucket: its first line lives in the bucket array itself, so most lookups touch
+// one cache line. Entries are kept packed, only the last line of the chain has free slots.
 class List
 {
     // private:
 public:
-    Node *top;
-    std::atomic<int> m_count;
+    Bucket head;
 
-    List() : top(nullptr), m_count(0) {}
+    bool insert(unsigned int key, unsigned int val, LinePool &pool)
+    {
+        // check if the key-val already exists
+        if (contains(key))
+        {
+            return false;
+        }
+        append(key, val, pool);
+        return true;
+    }
 
-    ~List()
+    // insert without the duplicate check
+    void append(unsigned int key, unsigned int val, LinePool &pool)
     {
-        Node *curr = top;
-        while (curr != nullptr)
+        Bucket *last = &head;
+        Bucket *next;
+        while ((next = last->next.load(std::memory_order_relaxed)) != nullptr)
         {
-            Node *tmp = curr;
-            curr = curr->next;
-            delete tmp;
+            last = next;
         }
+        uint32_t n = last->count.load(std::memory_order_relaxed);
+        if (n < Bucket::SLOTS)
+        {
+            last->set(n, key, val);
+            last->count.store(n + 1, std::memory_order_relaxed);
+            return;
+        }
+        Bucket *line = take_line(pool);
+        line->set(0, key, val);
+        line->count.store(1, std::memory_order_relaxed);
+        last->next.store(line, std::memory_order_release);
     }
 
-    bool insert(unsigned int key, unsigned int val)
+    bool del(unsigned int key, LinePool &pool)
     {
-        // check if the key-val already exists
-        Node *curr = top;
-        while (curr != nullptr)
+        Bucket *found = nullptr;
+        int slot = 0;
+        Bucket *last = &head;
+        Bucket *before_last = nullptr;
+        for (Bucket *line = &head; line != nullptr; line = line->next.load(std::memory_order_relaxed))
         {
-            if (curr->key == key)
+            if (found == nullptr)
             {
-                return false;
+                unsigned int m = line->match(key);
+                if (m != 0)
+                {
+                    found = line;
+                    slot = __builtin_ctz(m);
+                }
+            }
+            if (line != &head)
+            {
+                before_last = last;
+                last = line;
             }
-            curr = curr->next;
         }
-        // else, insert at top
-        Node *newNode = new Node(key, val, top);
-        top = newNode;
-        m_count++;
+        if (found == nullptr)
+        {
+            return false;
+        }
+
+        // fill the hole with the last entry of the chain
+        uint32_t n = last->count.load(std::memory_order_relaxed) - 1;
+        if (found != last || slot != static_cast<int>(n))
+        {
+            found->set(slot, last->key_at(n), last->values[n].load(std::memory_order_relaxed));
+        }
+        last->count.store(n, std::memory_order_relaxed);
+        if (n == 0 && last != &head)
+        {
+            before_last->next.store(nullptr, std::memory_order_relaxed);
+            pool.release(last);
+        }
         return true;
     }
 
-    bool del(unsigned int key)
+    // Empties the bucket, its overflow lines go back to the pool.
+    void clear(LinePool &pool)
     {
-        Node *curr = top;
-        Node *prev = nullptr;
+        Bucket *line = head.next.load(std::memory_order_relaxed);
+        while (line != nullptr)
+        {
+            Bucket *next = line->next.load(std::memory_order_relaxed);
+            pool.release(line);
+            line = next;
+        }
+        head.next.store(nullptr, std::memory_order_relaxed);
+        head.count.store(0, std::memory_order_relaxed);
+    }
 
-        while (curr != nullptr)
+    bool contains(unsigned int key) const
+    {
+        return getval(key).first;
+    }
+
+    // the value slot of key, nullptr if it is absent
+    std::atomic<uint32_t> *find(unsigned int key)
+    {
+        for (Bucket *line = &head; line != nullptr; line = line->next.load(std::memory_order_relaxed))
         {
-            if (curr->key == key)
+            unsigned int m = line->match(key);
+            if (m != 0)
             {
-                if (prev == nullptr)
-                {
-                    top = curr->next;
-                }
-                else
-                {
-                    prev->next = curr->next;
-                }
-                delete curr;
-                m_count--;
-                return true;
+                return &line->values[__builtin_ctz(m)];
             }
-            prev = curr;
-            curr = curr->next;
         }
-        return false;
+        return nullptr;
     }
 
-    bool contains(unsigned int key)
+    std::pair<bool, unsigned int> getval(unsigned int key) const
     {
-        Node *curr = top;
-        while (curr != nullptr)
+        const Bucket *line = &head;
+        while (line != nullptr)
         {
-            if (curr->key == key)
-                return true;
-            curr = curr->next;
+            unsigned int m = line->match(key);
+            if (m != 0)
+            {
+                return {true, line->values[__builtin_ctz(m)].load(std::memory_order_relaxed)};
+            }
+            line = line->next.load(std::memory_order_acquire);
         }
-        return false;
+        return {false, 0}; // return 0 for failed search.
     }
+};
+static_assert(std::is_trivially_destructible<List>::value, "BucketArray frees its lists without destroying them");
 
-    std::pair<bool, unsigned int> getval(unsigned int key) const
+// One generation of buckets. While a resize is in progress the new generation
+// points to the old one through prev, and buckets are moved over a few at a time.
+// Either capacity may be the larger one, both are powers of 2. Once drained the old
+// generation goes to the epoch reclaimer (epoch.h), lookups may still be reading it.
+struct BucketArray
+{
+    size_t capacity;
+    // Raw storage, so that allocating a big generation costs no more than the page faults.
+    // Buckets of a resized generation are constructed by migrate_bucket().
+    List *lists;
+    char *migrated;                        // set once the bucket is moved, written under its stripe lock
+    std::atomic<BucketArray *> prev;       // generation being drained, nullptr when done
+    std::atomic<size_t> migrate_next;      // next bucket of prev to hand out to helpers
+    std::atomic<size_t> migrate_done;      // buckets of prev already moved
+
+    BucketArray(size_t cap, BucketArray *old = nullptr)
+        : capacity(cap), prev(old), migrate_next(0), migrate_done(0)
     {
-        Node *curr = top;
-        while (curr != nullptr)
+        lists = static_cast<List *>(::operator new(cap * sizeof(List), std::align_val_t(alignof(List))));
+        migrated = static_cast<char *>(calloc(cap, sizeof(char)));
+        if (old == nullptr)
         {
-            if (curr->key == key)
+            for (size_t i = 0; i < cap; ++i)
             {
-                return {true, curr->value};
+                new (&lists[i]) List();
             }
-            curr = curr->next;
         }
-        return {false, 0}; // return 0 for failed search.
+    }
+
+    // List is trivially destructible and its overflow lines belong to the pool,
+    // so the whole generation goes at once.
+    ~BucketArray()
+    {
+        ::operator delete(lists, std::align_val_t(alignof(List)));
+        free(migrated);
     }
 };
 
+template <typename Hash>
 class Table
 {
 public:
-    std::vector<List *> tbl;
-    std::atomic<size_t> size;
+    std::atomic<BucketArray *> current;
+    ShardedCounter size;
     std::atomic<size_t> capacity;
+    std::shared_ptr<LinePool> pool_owner;
+    LinePool &pool; // every overflow line of every generation
 
-    Table(size_t cap) : size(0), capacity(cap)
+    Table(size_t cap, std::shared_ptr<LinePool> shared_pool)
+        : current(new BucketArray(cap)), capacity(cap),
+          pool_owner(shared_pool != nullptr ? std::move(shared_pool) : std::make_shared<LinePool>()), pool(*pool_owner)
     {
-        tbl.resize(cap);
-        for (size_t i = 0; i < cap; ++i)
-        {
-            tbl[i] = new List();
-        }
     }
 
     ~Table()
     {
-        for (List *list : tbl)
-        {
-            delete list;
-        }
+        BucketArray *cur = current.load();
+        delete cur->prev.load();
+        delete cur;
     }
 
-    // TODO: hash should be a function pointer, which can change based on the size of the hash table.
-    size_t hash(unsigned int key) const
+    // cap is a power of 2, so the bucket is the low bits of the hash
+    static size_t hash(unsigned int key, size_t cap)
     {
-        return std::hash<uint32_t>{}(key) % capacity.load(std::memory_order_relaxed);
+        return Hash{}(key) & (cap - 1);
     }
 };
 
-class HashTable
+// Hash picks the bucket and the stripe of a key, see hash_policy.h.
+template <typename Hash>
+class BasicHashTable
 {
 private:
-    size_t lock_length;
-    Table table;
-    // pthread_mutex_t *locks; // make it reentrant
-    std::vector<std::recursive_mutex> locks; // I'm not sure, which one will work better
+    // Number of buckets of the old generation every insert/remove moves on its way out.
+    static constexpr size_t MIGRATE_CHUNK = 4;
+    // Writers fold their share of the size into the total every capacity / BUCKETS_PER_FOLD
+    // updates. With 64 shards the load the policy sees is off by less than 1/8 per bucket.
+    static constexpr size_t BUCKETS_PER_FOLD = 512;
+    // Default number of stripes per hardware thread.
+    static constexpr size_t STRIPES_PER_THREAD = 32;
+    // Keys a batch call partitions at a time, per stripe. Bounds how long it holds one stripe.
+    static constexpr size_t BATCH_PER_STRIPE = 64;
+    // Lookups a batched read keeps in flight: enough to overlap the misses, few enough
+    // that the prefetched lines are still in L1 when they are read.
+    static constexpr size_t PREFETCH_GROUP = 16;
 
-    void resize();
-    bool needs_resize() const
+    size_t lock_length; // a power of 2
+    ResizePolicy policy;
+    Table<Hash> table;
+    std::vector<Stripe> stripes;
+    std::atomic<bool> resizing;
+    std::atomic<size_t> min_capacity; // shrinking stops here, raised by reserve()
+
+    static size_t default_stripes()
     {
-        // TODO: add some good logic for checking resizing condition
-        return table.size.load() >= table.capacity.load() * 0.75;
+        return STRIPES_PER_THREAD * std::max(1u, std::thread::hardware_concurrency());
     }
 
-public:
-    HashTable(size_t cap) : lock_length(cap), table(cap), locks(cap)
+    static size_t round_up_pow2(size_t n)
     {
-        // locks = new pthread_mutex_t[cap];
-        // pthread_mutexattr_t attr;
-        // pthread_mutexattr_init(&attr);
-        // pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE); // reentrant
-
-        // for (size_t i = 0; i < cap; ++i)
-        // {
-        //     pthread_mutex_init(&locks[i], &attr);
-        // }
-
-        // pthread_mutexattr_destroy(&attr);
+        size_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
     }
 
-    ~HashTable() = default;
-    // { delete[] locks;}
+    // enough buckets for cap entries, and at least one per stripe
+    size_t initial_buckets(size_t cap) const
+    {
+        return std::max(policy.min_buckets(cap), lock_length);
+    }
 
-    // void acquire(unsigned int key)
-    // {
-    //     size_t lock_index = table.hash(key) % lock_length;
+    // Capacities are powers of 2 no smaller than lock_length, so the stripe is made of the
+    // lowest bits of the bucket index. It stays the same in every generation, and covers
+    // every bucket of another generation that a bucket maps to.
+    size_t lock_index(unsigned int key) const
+    {
+        return Table<Hash>::hash(key, lock_length);
+    }
 
-    //     while (pthread_mutex_lock(&locks[lock_index]) != 0)
-    //     {
-    //         std::this_thread::sleep_for(std::chrono::seconds(1));
-    //     }
+    // Starts moving the entries to a generation of new_cap buckets, 0 lets the policy
+    // pick. Returns false if another resize is still running.
+    bool resize(size_t new_cap = 0);
+    // must hold the stripe lock of bucket i of b->prev and an EpochGuard
+    void migrate_bucket(BucketArray *b, size_t i);
+    // Moves a few buckets of the generation being drained. Returns false if there
+    // were none left to hand out.
+    bool help_migrate();
+    // helps until no resize is running
+    void finish_resize();
+    // resizes to at least buckets buckets, after any running resize
+    void grow_to(size_t buckets);
+    // must hold the stripe lock of key, moves its old bucket first if needed
+    List *bucket_for(unsigned int key);
+    // lock-free lookup, retries if a writer changed the stripe meanwhile
+    std::pair<bool, unsigned int> read_optimistic(unsigned int key);
+    // Starts loading the lines read_optimistic(key) will touch first. Returns the
+    // bucket it prefetched, or nullptr while a resize is moving buckets. Must hold
+    // an EpochGuard for as long as the bucket is used.
+    const List *prefetch_bucket(unsigned int key) const;
+    // Appends the entries of stripe s to out, under its lock and after moving its
+    // buckets out of a generation being drained. Entries never change stripes, so
+    // this is a snapshot of the stripe.
+    void copy_stripe(size_t s, std::vector<KeyValue> &out);
+    // bookkeeping after n entries were added or removed, outside the stripe lock
+    void added(size_t n);
+    void removed(size_t n);
+    // bucket count the policy asks for at the current size, the current one if it is content
+    size_t wanted_capacity() const;
+    void set_capacity(size_t cap)
+    {
+        table.capacity.store(cap);
+        table.size.set_fold(cap / BUCKETS_PER_FOLD);
+    }
+    bool needs_resize() const
+    {
+        return wanted_capacity() != table.capacity.load();
+    }
 
-    //     return;
-    // }
+public:
+    // cap is the number of entries the table should hold before its first resize.
+    // num_stripes is the number of locks, rounded up to a power of 2. 0 picks
+    // STRIPES_PER_THREAD per hardware thread. Tables given the same pool take their
+    // overflow lines from it, nullptr gives the table a pool of its own.
+    BasicHashTable(size_t cap, size_t num_stripes = 0, ResizePolicy resize_policy = ResizePolicy(),
+                   std::shared_ptr<LinePool> pool = nullptr)
+        : lock_length(round_up_pow2(num_stripes != 0 ? num_stripes : default_stripes())), policy(resize_policy),
+          table(initial_buckets(cap), std::move(pool)), stripes(lock_length), resizing(false), min_capacity(lock_length)
+    {
+        assert(policy.valid());
+        set_capacity(table.capacity.load());
+    }
 
-    // void release(unsigned int key)
-    // {
-    //     pthread_mutex_unlock(&locks[table.hash(key) % lock_length]);
-    //     return;
-    // }
+    ~BasicHashTable() = default;
 
     bool contains(unsigned int key);
 
@@ -205,4 +423,203 @@ public:
     bool remove(unsigned int key);
 
     std::pair<bool, unsigned int> get_value(unsigned int key);
-};
\ No newline at end of file
+
+    // Number of entries, adds up the per-thread counts. Exact while no writer is running.
+    size_t size() const
+    {
+        return std::max<int64_t>(table.size.sum(), 0);
+    }
+
+    // Grows the table to hold n entries without resizing, and keeps it from shrinking
+    // below that until shrink_to_fit(). Waits for a running resize first.
+    void reserve(size_t n);
+
+    // Shrinks the table to the fewest buckets that hold its entries, and drops the
+    // floor set by reserve(). Waits for a running resize first, and for the drained
+    // generations to be freed after, so it must not be called inside an EpochGuard.
+    void shrink_to_fit();
+
+    // Same results as calling insert/remove for every key in order, written to result[i].
+    // The keys are grouped by stripe first, so every stripe is locked once per group.
+    void insert_batch(const KeyValue *kv_pairs, size_t n, bool *result);
+
+    void remove_batch(const uint32_t *keys, size_t n, bool *result);
+
+    // Inserts n pairs using threads threads, with the same results as insert() in input
+    // order. The table is sized for them up front, the pairs are partitioned by stripe
+    // in parallel, and then each stripe is filled by one thread under a single lock
+    // acquisition. result may be nullptr. Returns the number of pairs inserted.
+    size_t bulk_load(const KeyValue *kv_pairs, size_t n, size_t threads, bool *result = nullptr);
+
+    // Writes the entries to path in the flat format of snapshot.h, through a temporary
+    // file that is renamed over path once complete. Stripes are copied one at a time
+    // like Iterator does, so writers may keep going. Returns false on an I/O error.
+    bool save(const char *path);
+
+    // Table with the entries of a snapshot written by save(), nullptr if path isn't one
+    // written with Hash. It gets the snapshot's bucket count, and threads threads fill
+    // its buckets straight from the mapped file, without hashing or duplicate checks.
+    // num_stripes and resize_policy are as for the constructor.
+    static BasicHashTable *load(const char *path, size_t threads = 1, size_t num_stripes = 0,
+                                ResizePolicy resize_policy = ResizePolicy());
+
+    // Same as get_value for every key: values[i] is 0 for a missing key, found[i] tells
+    // them apart if it is given. Keys are looked up PREFETCH_GROUP at a time, so their
+    // cache misses overlap instead of being paid one after the other.
+    void get_value_batch(const uint32_t *keys, size_t n, uint32_t *values, bool *found = nullptr);
+
+    // Read-modify-write of one key under a single stripe acquisition. fn(found, value)
+    // gets the current value (0 if the key is absent) and leaves the new one in value.
+    // It runs with the stripe locked, so it must be short and must not use the table.
+    // Returns true if the key was inserted.
+    template <typename Fn>
+    bool upsert(unsigned int key, Fn fn)
+    {
+        size_t lck = lock_index(key);
+        bool inserted;
+        {
+            std::lock_guard<StripeLock> lock(stripes[lck].lock);
+            List *l = bucket_for(key);
+            SeqWriter w(stripes[lck].seq);
+            std::atomic<uint32_t> *slot = l->find(key);
+            inserted = (slot == nullptr);
+            uint32_t val = inserted ? 0 : slot->load(std::memory_order_relaxed);
+            fn(!inserted, val);
+            if (inserted)
+                l->append(key, val, table.pool);
+            else
+                slot->store(val, std::memory_order_relaxed);
+        }
+        if (inserted)
+            added(1);
+        help_migrate();
+        return inserted;
+    }
+
+    // Adds delta to the value of key, inserting delta if it is absent.
+    // Returns the value before (0 if absent).
+    unsigned int fetch_add(unsigned int key, unsigned int delta);
+
+    // Returns true if the key was inserted, false if an existing value was replaced.
+    bool insert_or_assign(unsigned int key, unsigned int val);
+
+    // Removes key if pred(value) holds, checked and removed under one stripe acquisition.
+    template <typename Pred>
+    bool erase_if(unsigned int key, Pred pred)
+    {
+        size_t lck = lock_index(key);
+        bool result = false;
+        {
+            std::lock_guard<StripeLock> lock(stripes[lck].lock);
+            List *l = bucket_for(key);
+            std::atomic<uint32_t> *slot = l->find(key);
+            if (slot != nullptr && pred(slot->load(std::memory_order_relaxed)))
+            {
+                SeqWriter w(stripes[lck].seq);
+                result = l->del(key, table.pool);
+            }
+        }
+        if (result)
+            removed(1);
+        help_migrate();
+        return result;
+    }
+
+    // Weakly consistent, single pass iteration. Stripes are copied one at a time
+    // under their lock and handed out from the copy, so the loop body runs with no
+    // lock held and may use the table. An entry that is there for the whole loop
+    // is seen exactly once, others may or may not be.
+    class Iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = KeyValue;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const KeyValue *;
+        using reference = const KeyValue &;
+
+        Iterator() = default; // end
+
+        const KeyValue &operator*() const { return entries[pos]; }
+        const KeyValue *operator->() const { return &entries[pos]; }
+
+        Iterator &operator++()
+        {
+            if (++pos == entries.size())
+                load_next();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        // only meaningful against end()
+        bool operator==(const Iterator &other) const { return ht == other.ht; }
+
+    private:
+        friend class BasicHashTable;
+
+        BasicHashTable *ht = nullptr; // nullptr once every stripe has been handed out
+        size_t next_stripe = 0;
+        std::vector<KeyValue> entries;
+        size_t pos = 0;
+
+        explicit Iterator(BasicHashTable *table) : ht(table) { load_next(); }
+
+        void load_next()
+        {
+            entries.clear();
+            pos = 0;
+            while (entries.empty() && next_stripe < ht->lock_length)
+            {
+                ht->copy_stripe(next_stripe++, entries);
+            }
+            if (entries.empty())
+                ht = nullptr;
+        }
+    };
+
+    Iterator begin() { return Iterator(this); }
+    Iterator end() { return Iterator(); }
+
+    // Calls fn(key, value) for every entry, on threads threads that take the stripes
+    // one at a time, with the same guarantees as Iterator. A thread holds at most one
+    // stripe lock, only while copying the stripe, and never while fn runs.
+    template <typename Fn>
+    void parallel_for_each(Fn fn, size_t threads)
+    {
+        std::atomic<size_t> next(0);
+        auto work = [&]()
+        {
+            std::vector<KeyValue> entries;
+            size_t s;
+            while ((s = next.fetch_add(1)) < lock_length)
+            {
+                entries.clear();
+                copy_stripe(s, entries);
+                for (const KeyValue &kv : entries)
+                {
+                    fn(kv.key, kv.value);
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t w = 1; w < threads; ++w)
+        {
+            workers.emplace_back(work);
+        }
+        work();
+        for (std::thread &t : workers)
+        {
+            t.join();
+        }
+    }
+};
+
+// The policies are instantiated in hash_table.cpp.
+extern template class BasicHashTable<IdentityHash>;
+extern template class BasicHashTable<FibonacciHash>;
+extern template class BasicHashTable<MurmurHash>;
+extern template class BasicHashTable<Crc32Hash>;
+
+using HashTable = BasicHashTable<FibonacciHash>;
+
+#endif
@@ -0,0 +1,27 @@
+// key_value.h
+#ifndef KEY_VALUE_H
+#define KEY_VALUE_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t key;
+    uint32_t value;
+} KeyValue;
+
+// Pack key-value into a 64-bit integer
+inline uint64_t packKeyValue(uint32_t key, uint32_t val)
+{
+    return (static_cast<uint64_t>(key) << 32) |
+           (static_cast<uint32_t>(val) & 0xFFFFFFFF);
+}
+
+// Function to unpack a 64-bit integer into two 32-bit integers
+inline void unpackKeyValue(uint64_t value, uint32_t &key, uint32_t &val)
+{
+    key = static_cast<uint32_t>(value >> 32);
+    val = static_cast<uint32_t>(value & 0xFFFFFFFF);
+}
+
+#endif
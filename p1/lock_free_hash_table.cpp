@@ -0,0 +1,215 @@
+#ifndef USE_TBB
+#include "lock_free_hash_table.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t cap = 1;
+    while (cap < n)
+        cap <<= 1;
+    return cap;
+}
+
+LockFreeHashTable::LockFreeHashTable(size_t cap)
+    : size(0), stripes(NUM_STRIPES)
+{
+    size_t buckets = round_up_pow2(std::max(cap / MAX_LOAD + 1, NUM_STRIPES));
+    capacity.store(buckets);
+    current.store(new LFBucketArray(buckets), std::memory_order_release);
+}
+
+static void free_list(std::atomic<MarkedPtr> &head)
+{
+    MarkedNode *n = head.load().getPointer();
+    while (n != nullptr)
+    {
+        MarkedNode *next = n->next.load().getPointer();
+        delete n;
+        n = next;
+    }
+}
+
+LockFreeHashTable::~LockFreeHashTable()
+{
+    LFBucketArray *cur = current.load();
+    // destroyed during a resize: the buckets not moved yet still hold their nodes
+    LFBucketArray *old_tbl = cur->prev.load();
+    if (old_tbl != nullptr)
+    {
+        for (size_t i = 0; i < old_tbl->capacity; ++i)
+        {
+            if (!old_tbl->migrated[i])
+                free_list(old_tbl->heads[i]);
+        }
+        delete old_tbl;
+    }
+    for (size_t i = 0; i < cur->capacity; ++i)
+    {
+        free_list(cur->heads[i]);
+    }
+    delete cur;
+}
+
+template <typename Op>
+auto LockFreeHashTable::run(unsigned int key, Op op)
+{
+    // covers the nodes op reads and the generation help_migrate() reads
+    EpochGuard guard;
+    std::atomic<size_t> *inside = gate.enter();
+    if (inside != nullptr)
+    {
+        LFBucketArray *b = current.load(std::memory_order_acquire);
+        auto result = op(&b->heads[hash(key, b->capacity)]);
+        gate.leave(inside);
+        return result;
+    }
+
+    decltype(op(nullptr)) result;
+    {
+        std::lock_guard<StripeLock> lock(stripes[lock_index(key)].lock);
+        result = op(bucket_for(key));
+    }
+    help_migrate();
+    return result;
+}
+
+void LockFreeHashTable::resize()
+{
+    // New operations take the stripe locks from here on
+    if (!gate.close())
+    {
+        // Someone is already resizing it
+        return;
+    }
+    if (!needs_resize())
+    {
+        gate.open();
+        return;
+    }
+
+    LFBucketArray *old_tbl = current.load();
+    size_t new_cap = old_tbl->capacity * 2;
+    capacity.store(new_cap);
+    current.store(new LFBucketArray(new_cap, old_tbl), std::memory_order_release);
+}
+
+void LockFreeHashTable::migrate_bucket(LFBucketArray *b, size_t i)
+{
+    LFBucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+    if (old_tbl == nullptr || old_tbl->migrated[i])
+        return;
+
+    // Nothing runs lock-free while resizing and the stripe is ours, so the nodes are
+    // relinked in place. The list stays sorted, and so do both halves.
+    std::atomic<MarkedPtr> *tails[2] = {&b->heads[i], &b->heads[i + old_tbl->capacity]};
+    MarkedNode *n = old_tbl->heads[i].load(std::memory_order_relaxed).getPointer();
+    while (n != nullptr)
+    {
+        MarkedPtr next = n->next.load(std::memory_order_relaxed);
+        if (next.getInt())
+        {
+            // removed, but its unlink failed
+            Epoch::retire(n);
+        }
+        else
+        {
+            std::atomic<MarkedPtr> *&tail = tails[hash(n->key, b->capacity) != i];
+            tail->store(MarkedPtr(n, false), std::memory_order_relaxed);
+            tail = &n->next;
+        }
+        n = next.getPointer();
+    }
+    tails[0]->store(MarkedPtr(nullptr, false), std::memory_order_relaxed);
+    tails[1]->store(MarkedPtr(nullptr, false), std::memory_order_relaxed);
+    old_tbl->heads[i].store(MarkedPtr(nullptr, false), std::memory_order_relaxed);
+    old_tbl->migrated[i] = 1;
+
+    if (b->migrate_done.fetch_add(1) + 1 == old_tbl->capacity)
+    {
+        // last bucket, the old generation is drained and lock-free operations can resume
+        b->prev.store(nullptr, std::memory_order_release);
+        Epoch::retire(old_tbl, old_tbl->capacity * (sizeof(std::atomic<MarkedPtr>) + sizeof(char)));
+        gate.open();
+    }
+}
+
+void LockFreeHashTable::help_migrate()
+{
+    LFBucketArray *b = current.load(std::memory_order_acquire);
+    LFBucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+    if (old_tbl == nullptr)
+        return;
+
+    for (size_t n = 0; n < MIGRATE_CHUNK; ++n)
+    {
+        size_t i = b->migrate_next.fetch_add(1);
+        if (i >= old_tbl->capacity)
+            return;
+        std::lock_guard<StripeLock> lock(stripes[i & (NUM_STRIPES - 1)].lock);
+        migrate_bucket(b, i);
+    }
+}
+
+std::atomic<MarkedPtr> *LockFreeHashTable::bucket_for(unsigned int key)
+{
+    LFBucketArray *b = current.load(std::memory_order_acquire);
+    LFBucketArray *old_tbl = b->prev.load(std::memory_order_acquire);
+    if (old_tbl != nullptr)
+    {
+        migrate_bucket(b, hash(key, old_tbl->capacity));
+    }
+    return &b->heads[hash(key, b->capacity)];
+}
+
+bool LockFreeHashTable::contains(unsigned int key)
+{
+    return get_value(key).first;
+}
+
+bool LockFreeHashTable::insert(unsigned int key, unsigned int val)
+{
+    bool success = run(key, [&](std::atomic<MarkedPtr> *head)
+                       {
+        // duplicates are common, don't allocate for them
+        if (HarrisList::lookup(head, key) != nullptr)
+            return false;
+        MarkedNode *node = new MarkedNode(key, key, val);
+        if (HarrisList::insert(head, node) != node)
+        {
+            delete node;
+            return false;
+        }
+        return true; });
+    if (success)
+    {
+        size++;
+        if (needs_resize())
+        {
+            resize();
+        }
+    }
+    return success;
+}
+
+bool LockFreeHashTable::remove(unsigned int key)
+{
+    bool success = run(key, [&](std::atomic<MarkedPtr> *head)
+                       { return HarrisList::remove(head, key); });
+    if (success)
+        size--;
+    return success;
+}
+
+std::pair<bool, unsigned int> LockFreeHashTable::get_value(unsigned int key)
+{
+    return run(key, [&](std::atomic<MarkedPtr> *head)
+               {
+        MarkedNode *n = HarrisList::lookup(head, key);
+        if (n == nullptr)
+            return std::pair<bool, unsigned int>(false, 0); // return 0 for failed search.
+        return std::pair<bool, unsigned int>(true, n->value.load(std::memory_order_relaxed)); });
+}
+
+#endif
@@ -0,0 +1,104 @@
+// lock_free_hash_table.h
+#ifndef LOCK_FREE_HASH_TABLE_H
+#define LOCK_FREE_HASH_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+#include "hash_policy.h"
+#include "harris_list.h"
+#include "stripe_lock.h"
+#include "resize_gate.h"
+
+// One generation of bucket lists, see BucketArray in hash_table.h.
+struct LFBucketArray
+{
+    size_t capacity; // a power of 2
+    std::atomic<MarkedPtr> *heads;
+    char *migrated;                   // set once the bucket is moved, written under its stripe lock
+    std::atomic<LFBucketArray *> prev; // generation being drained, nullptr when done
+    std::atomic<size_t> migrate_next;
+    std::atomic<size_t> migrate_done;
+
+    LFBucketArray(size_t cap, LFBucketArray *old = nullptr)
+        : capacity(cap), heads(new std::atomic<MarkedPtr>[cap]), migrated(static_cast<char *>(calloc(cap, sizeof(char)))),
+          prev(old), migrate_next(0), migrate_done(0)
+    {
+        for (size_t i = 0; i < cap; ++i)
+        {
+            heads[i].store(MarkedPtr(nullptr, false), std::memory_order_relaxed);
+        }
+    }
+
+    ~LFBucketArray()
+    {
+        delete[] heads;
+        free(migrated);
+    }
+};
+
+// Chained table whose buckets are Harris-Michael lock-free lists, so insert, remove
+// and lookups take no lock while the table is not resizing. A resize first closes the
+// gate, which waits for the lock-free operations in flight. Until its last bucket is moved,
+// operations go through the stripe locks and move buckets on the way, as in HashTable.
+// Removed nodes and drained generations are freed through the epoch reclaimer.
+class LockFreeHashTable
+{
+private:
+    // Number of buckets of the old generation every operation moves while resizing.
+    static constexpr size_t MIGRATE_CHUNK = 4;
+    // Average entries per bucket before growing, every node is its own cache miss.
+    static constexpr size_t MAX_LOAD = 2;
+    // Only taken while resizing.
+    static constexpr size_t NUM_STRIPES = 1024;
+
+    std::atomic<LFBucketArray *> current;
+    std::atomic<size_t> size;
+    std::atomic<size_t> capacity;
+    ResizeGate gate; // closed from the start of a resize until its last bucket is moved
+    std::vector<Stripe> stripes;
+
+    static size_t hash(unsigned int key, size_t cap)
+    {
+        return FibonacciHash{}(key) & (cap - 1);
+    }
+
+    // Capacities are powers of 2 no smaller than NUM_STRIPES, so a bucket and both
+    // of its halves share a stripe.
+    size_t lock_index(unsigned int key) const
+    {
+        return hash(key, NUM_STRIPES);
+    }
+
+    // Runs op on the head of key's bucket: lock-free, or under the stripe lock while resizing.
+    template <typename Op>
+    auto run(unsigned int key, Op op);
+
+    void resize();
+    // must hold the stripe lock of bucket i of b->prev
+    void migrate_bucket(LFBucketArray *b, size_t i);
+    void help_migrate();
+    // must hold the stripe lock of key, moves its old bucket first if needed
+    std::atomic<MarkedPtr> *bucket_for(unsigned int key);
+    bool needs_resize() const
+    {
+        return size.load() >= capacity.load() * MAX_LOAD;
+    }
+
+public:
+    LockFreeHashTable(size_t cap);
+    ~LockFreeHashTable();
+
+    bool contains(unsigned int key);
+
+    bool insert(unsigned int key, unsigned int val);
+
+    bool remove(unsigned int key);
+
+    std::pair<bool, unsigned int> get_value(unsigned int key);
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef USE_TBB
+#include "oa_hash_table.h"
+#include "../epoch.h"
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t cap = 1;
+    while (cap < n)
+        cap <<= 1;
+    return cap;
+}
+
+OAHashTable::OAHashTable(size_t cap) : size(0), used(0), reserved(0)
+{
+    // keep the load below 0.75 for cap entries
+    current.store(new OASlots(round_up_pow2(cap + cap / 3 + 1)), std::memory_order_release);
+}
+
+OAHashTable::~OAHashTable()
+{
+    delete current.load();
+}
+
+void OAHashTable::resize()
+{
+    std::unique_lock<std::shared_mutex> lock(resize_mtx);
+    OASlots *old_slots = current.load(std::memory_order_relaxed);
+    if (!needs_resize(old_slots))
+    {
+        // Someone already resized it
+        return;
+    }
+
+    // Writers are blocked, so the old slots can be read without CAS.
+    size_t live = 0;
+    for (size_t i = 0; i < old_slots->capacity; ++i)
+    {
+        uint64_t w = old_slots->slots[i].load(std::memory_order_relaxed);
+        if ((w >> 32) != OA_EMPTY_KEY)
+            live++;
+    }
+
+    // grow only if the live entries need it, otherwise this just drops the tombstones.
+    size_t new_cap = old_slots->capacity;
+    while (live >= new_cap / 2)
+        new_cap *= 2;
+
+    OASlots *new_slots = new OASlots(new_cap);
+    for (size_t i = 0; i < old_slots->capacity; ++i)
+    {
+        uint64_t w = old_slots->slots[i].load(std::memory_order_relaxed);
+        if ((w >> 32) == OA_EMPTY_KEY)
+            continue;
+        size_t idx = new_slots->home(w >> 32);
+        while (new_slots->slots[idx].load(std::memory_order_relaxed) != OA_EMPTY)
+            idx = (idx + 1) & new_slots->mask;
+        new_slots->slots[idx].store(w, std::memory_order_relaxed);
+    }
+
+    used.store(live, std::memory_order_relaxed);
+    current.store(new_slots, std::memory_order_release);
+    lock.unlock();
+    // readers may still be probing the old slots
+    Epoch::retire(old_slots, sizeof(OASlots) + old_slots->capacity * sizeof(std::atomic<uint64_t>));
+}
+
+bool OAHashTable::contains(unsigned int key)
+{
+    return get_value(key).first;
+}
+
+bool OAHashTable::insert(unsigned int key, unsigned int val)
+{
+    if (key == OA_EMPTY_KEY)
+    {
+        uint64_t expected = 0;
+        bool success = reserved.compare_exchange_strong(expected, (1ULL << 32) | val);
+        if (success)
+            size++;
+        return success;
+    }
+
+    uint64_t kv = packKeyValue(key, val);
+    while (true)
+    {
+        bool success = false;
+        bool found = false;
+        bool grow = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(resize_mtx);
+            OASlots *s = current.load(std::memory_order_acquire);
+            size_t idx = s->home(key);
+            // Tombstones are never reused, otherwise two inserts of the same key
+            // could claim different slots. Both stop at the same first empty slot instead.
+            for (size_t n = 0; n < s->capacity && !success && !found; ++n, idx = (idx + 1) & s->mask)
+            {
+                uint64_t w = s->slots[idx].load(std::memory_order_acquire);
+                while (w == OA_EMPTY && !success)
+                {
+                    success = s->slots[idx].compare_exchange_weak(w, kv, std::memory_order_acq_rel, std::memory_order_acquire);
+                }
+                if (!success && (w >> 32) == key)
+                    found = true;
+            }
+            if (success)
+            {
+                size++;
+                used++;
+            }
+            grow = !found && (!success || needs_resize(s));
+        }
+        // release the shared lock first, before contending for resize
+        if (grow)
+            resize();
+        if (success || found)
+            return success;
+        // probe sequence was full of tombstones, retry on the rehashed slots
+    }
+}
+
+bool OAHashTable::remove(unsigned int key)
+{
+    if (key == OA_EMPTY_KEY)
+    {
+        bool success = (reserved.exchange(0) != 0);
+        if (success)
+            size--;
+        return success;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(resize_mtx);
+    OASlots *s = current.load(std::memory_order_acquire);
+    size_t idx = s->home(key);
+    for (size_t n = 0; n < s->capacity; ++n, idx = (idx + 1) & s->mask)
+    {
+        uint64_t w = s->slots[idx].load(std::memory_order_acquire);
+        if (w == OA_EMPTY)
+            return false;
+        if ((w >> 32) == key)
+        {
+            // only a concurrent remove can change a live slot
+            if (s->slots[idx].compare_exchange_strong(w, OA_TOMBSTONE, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                size--;
+                return true;
+            }
+            return false;
+        }
+    }
+    return false;
+}
+
+std::pair<bool, unsigned int> OAHashTable::get_value(unsigned int key)
+{
+    if (key == OA_EMPTY_KEY)
+    {
+        uint64_t r = reserved.load(std::memory_order_acquire);
+        return {r != 0, static_cast<uint32_t>(r)};
+    }
+
+    // lock-free: a resize never writes into slots that readers can see, and
+    // doesn't free them while a guard is held
+    EpochGuard guard;
+    OASlots *s = current.load(std::memory_order_acquire);
+    size_t idx = s->home(key);
+    for (size_t n = 0; n < s->capacity; ++n, idx = (idx + 1) & s->mask)
+    {
+        uint64_t w = s->slots[idx].load(std::memory_order_acquire);
+        if (w == OA_EMPTY)
+            break;
+        if ((w >> 32) == key)
+        {
+            uint32_t k, v;
+            unpackKeyValue(w, k, v);
+            return {true, v};
+        }
+    }
+    return {false, 0}; // return 0 for failed search.
+}
+
+#endif
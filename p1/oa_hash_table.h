@@ -0,0 +1,78 @@
+// oa_hash_table.h
+#ifndef OA_HASH_TABLE_H
+#define OA_HASH_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include "key_value.h"
+
+// Open addressing table, every slot is one packed (key, value) word.
+// Key OA_EMPTY_KEY is used for the slot markers, so a real entry with that key
+// is kept in a separate word (OAHashTable::reserved).
+static constexpr uint32_t OA_EMPTY_KEY = 0xFFFFFFFF;
+static const uint64_t OA_EMPTY = packKeyValue(OA_EMPTY_KEY, 0);
+static const uint64_t OA_TOMBSTONE = packKeyValue(OA_EMPTY_KEY, 1);
+
+struct OASlots
+{
+    size_t capacity; // always a power of 2
+    size_t mask;
+    unsigned int shift;
+    std::atomic<uint64_t> *slots;
+
+    OASlots(size_t cap) : capacity(cap), mask(cap - 1), shift(64 - __builtin_ctzll(cap))
+    {
+        slots = new std::atomic<uint64_t>[cap];
+        for (size_t i = 0; i < cap; ++i)
+        {
+            slots[i].store(OA_EMPTY, std::memory_order_relaxed);
+        }
+    }
+
+    ~OASlots() { delete[] slots; }
+
+    // fibonacci hashing, identity hash + linear probing clusters badly on sequential keys.
+    size_t home(uint32_t key) const
+    {
+        return shift == 64 ? 0 : (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> shift;
+    }
+};
+
+// Lookups take no lock, so a slot array replaced by resize() goes to the epoch
+// reclaimer (epoch.h) and get_value runs inside an EpochGuard. Writers need none,
+// resize_mtx keeps the slot array from being swapped under them.
+class OAHashTable
+{
+private:
+    std::atomic<OASlots *> current;
+    std::atomic<size_t> size;
+    std::atomic<size_t> used; // live entries + tombstones, decides when to rehash
+    std::atomic<uint64_t> reserved; // entry for OA_EMPTY_KEY: 0 if absent, (1 << 32 | val) otherwise
+
+    // Writers hold it shared, resize() holds it exclusive. Readers never touch it.
+    std::shared_mutex resize_mtx;
+
+    void resize();
+    bool needs_resize(const OASlots *s) const
+    {
+        return used.load(std::memory_order_relaxed) >= s->capacity * 0.75;
+    }
+
+public:
+    OAHashTable(size_t cap);
+    ~OAHashTable();
+
+    bool contains(unsigned int key);
+
+    bool insert(unsigned int key, unsigned int val);
+
+    bool remove(unsigned int key);
+
+    std::pair<bool, unsigned int> get_value(unsigned int key);
+};
+
+#endif
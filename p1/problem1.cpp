@@ -11,17 +11,25 @@
 #include <pthread.h>
 #include <vector>
 #include <cmath>  
+#include <algorithm>
+#include <malloc.h>
+
+#include "key_value.h"
 
 #ifndef USE_TBB
 #include "hash_table.h"
+#include "oa_hash_table.h"
+#include "cuckoo_hash_table.h"
+#include "split_ordered_hash_table.h"
+#include "lock_free_hash_table.h"
+#include "swiss_hash_table.h"
+#include "sharded_hash_table.h"
+#include "snapshot.h"
 #endif
 
 #ifdef USE_TBB
 #include <tbb/concurrent_hash_map.h>
 using TbbHashTable = tbb::concurrent_hash_map<uint32_t, uint32_t>;
-#else
-
-class HashTable;
 #endif
 
 using std::cout;
@@ -32,31 +40,13 @@ using HR = std::chrono::high_resolution_clock;
 using HRTimer = HR::time_point;
 using std::chrono::microseconds;
 using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
 using std::filesystem::path;
 
 static constexpr uint64_t RANDOM_SEED = 42;
 // static const uint32_t bucket_count = 1000;
 static constexpr uint64_t MAX_OPERATIONS = 1e+15;
 
-typedef struct
-{
-    uint32_t key;
-    uint32_t value;
-} KeyValue;
-
-// Pack key-value into a 64-bit integer
-inline uint64_t packKeyValue(uint32_t key, uint32_t val)
-{
-    return (static_cast<uint64_t>(key) << 32) |
-           (static_cast<uint32_t>(val) & 0xFFFFFFFF);
-}
-
-// Function to unpack a 64-bit integer into two 32-bit integers
-inline void unpackKeyValue(uint64_t value, uint32_t &key, uint32_t &val)
-{
-    key = static_cast<uint32_t>(value >> 32);
-    val = static_cast<uint32_t>(value & 0xFFFFFFFF);
-}
 void create_file(path pth, const uint32_t *data, uint64_t size)
 {
     FILE *fptr = NULL;
@@ -91,6 +81,15 @@ uint64_t INSERT = 100;
 uint64_t DELETE = 0;
 uint64_t runs = 2;
 uint64_t NO_THREADS = std::thread::hardware_concurrency();
+uint64_t TABLE_IMPL = 0; // 0: chained HashTable, 1: open addressing OAHashTable, 2: CuckooHashTable, 3: SplitOrderedHashTable, 4: LockFreeHashTable, 5: SwissHashTable, 6: ShardedHashTable
+uint64_t LATENCY = 0;    // record per-insert latency and report its percentiles
+uint64_t STRIPES = 0;    // lock stripes of the chained HashTable, 0 lets it pick
+uint64_t HASH_POLICY = 0; // hash of the chained HashTable: 0 fibonacci, 1 identity, 2 murmur, 3 crc32
+uint64_t BATCHED = 0;    // 1: each thread hands its whole chunk to the table's batch calls
+uint64_t BULK_LOAD = 0;  // 1: the insert kernel is one bulk_load call, where the table has one
+uint64_t SNAPSHOT = 0;   // 1: time saving the chained table and loading it back after each run
+uint64_t SHARDS = 16;    // shards of the ShardedHashTable
+uint64_t NUMA = 0;       // 1: spread the shards of the ShardedHashTable over the NUMA nodes
 
 void validFlagsDescription()
 {
@@ -99,6 +98,15 @@ void validFlagsDescription()
     cout << "add: percentage of insert queries\n";
     cout << "rem: percentage of delete queries\n";
     cout << "thr: number of threads to use\n";
+    cout << "tbl: hash table to use (0: chained, 1: open addressing, 2: cuckoo, 3: split-ordered, 4: lock-free chained, 5: swiss, 6: sharded chained)\n";
+    cout << "lat: 1 to report insert latency percentiles\n";
+    cout << "stp: number of lock stripes for the chained table (default: 32 per hardware thread)\n";
+    cout << "hsh: hash of the chained and sharded tables (0: fibonacci, 1: identity, 2: murmur, 3: crc32)\n";
+    cout << "shd: number of shards of the sharded table (default: 16)\n";
+    cout << "nma: 1 to build each shard of the sharded table on its own NUMA node\n";
+    cout << "bat: 1 to insert/delete/search through the batch API, where the table has one\n";
+    cout << "bld: 1 to run the insert kernel as a single parallel bulk load, where the table has one\n";
+    cout << "snp: 1 to save the chained table to a snapshot after each run and time loading it back\n";
 }
 
 // Code snippet to parse command line flags and initialize the variables
@@ -126,7 +134,7 @@ int parse_args(char *arg)
     {
         NUM_OPS = val;
     }
-    else if (s1 == "thr")
+    else if (s1 == "-thr")
     {
         NO_THREADS = val;
         assert(val > 0);
@@ -143,6 +151,42 @@ int parse_args(char *arg)
     {
         DELETE = val;
     }
+    else if (s1 == "-tbl")
+    {
+        TABLE_IMPL = val;
+    }
+    else if (s1 == "-lat")
+    {
+        LATENCY = val;
+    }
+    else if (s1 == "-stp")
+    {
+        STRIPES = val;
+    }
+    else if (s1 == "-hsh")
+    {
+        HASH_POLICY = val;
+    }
+    else if (s1 == "-bat")
+    {
+        BATCHED = val;
+    }
+    else if (s1 == "-bld")
+    {
+        BULK_LOAD = val;
+    }
+    else if (s1 == "-snp")
+    {
+        SNAPSHOT = val;
+    }
+    else if (s1 == "-shd")
+    {
+        SHARDS = val;
+    }
+    else if (s1 == "-nma")
+    {
+        NUMA = val;
+    }
     else
     {
         std::cout << "Unsupported flag:" << s1 << "\n";
@@ -153,66 +197,55 @@ int parse_args(char *arg)
     return 0;
 }
 
-#ifdef USE_TBB
-struct InsertArgs
-{
-    size_t start;
-    size_t end;
-    TbbHashTable *tbb_ht;
-    KeyValue *kv_pairs;
-    bool *result;
-};
-struct DeleteArgs
-{
-    size_t start;
-    size_t end;
-    TbbHashTable *tbb_ht;
-    uint32_t *key_list;
-    bool *result;
-};
-struct LookupArgs
-{
-    size_t start;
-    size_t end;
-    TbbHashTable *tbb_ht;
-    uint32_t *key_list;
-    uint32_t *result;
-};
-#else
+template <typename HT>
 struct InsertArgs
 {
     size_t start;
     size_t end;
-    HashTable *ht;
+    HT *ht;
     KeyValue *kv_pairs;
     bool *result;
+    uint32_t *latency_ns; // nullptr unless latencies are recorded
 };
+template <typename HT>
 struct DeleteArgs
 {
     size_t start;
     size_t end;
-    HashTable *ht;
+    HT *ht;
     uint32_t *key_list;
     bool *result;
 };
+template <typename HT>
 struct LookupArgs
 {
     size_t start;
     size_t end;
-    HashTable *ht;
+    HT *ht;
     uint32_t *key_list;
     uint32_t *result;
 };
-#endif
 
+template <typename HT>
 static void *insertWorker(void *arg)
 {
-    InsertArgs *wargs = static_cast<InsertArgs *>(arg);
+    InsertArgs<HT> *wargs = static_cast<InsertArgs<HT> *>(arg);
+    if constexpr (requires(HT *ht, KeyValue *kv, bool *res) { ht->insert_batch(kv, size_t(0), res); })
+    {
+        if (BATCHED && wargs->latency_ns == nullptr)
+        {
+            wargs->ht->insert_batch(wargs->kv_pairs + wargs->start, wargs->end - wargs->start, wargs->result + wargs->start);
+            pthread_exit(nullptr);
+        }
+    }
     for (size_t i = wargs->start; i < wargs->end; ++i)
     {
+        HRTimer op_start;
+        if (wargs->latency_ns != nullptr)
+            op_start = HR::now();
 #ifdef USE_TBB
         TbbHashTable::accessor acc;
-        bool created = wargs->tbb_ht->insert(acc, wargs->kv_pairs[i].key);
+        bool created = wargs->ht->insert(acc, wargs->kv_pairs[i].key);
         if (created)
         {
             acc->second = wargs->kv_pairs[i].value;
@@ -221,18 +254,29 @@ static void *insertWorker(void *arg)
 #else
         wargs->result[i] = wargs->ht->insert(wargs->kv_pairs[i].key, wargs->kv_pairs[i].value);
 #endif
+        if (wargs->latency_ns != nullptr)
+            wargs->latency_ns[i] = duration_cast<nanoseconds>(HR::now() - op_start).count();
     }
     pthread_exit(nullptr);
     return nullptr;
 }
 
+template <typename HT>
 static void *deleteWorker(void *arg)
 {
-    DeleteArgs *wargs = static_cast<DeleteArgs *>(arg);
+    DeleteArgs<HT> *wargs = static_cast<DeleteArgs<HT> *>(arg);
+    if constexpr (requires(HT *ht, uint32_t *keys, bool *res) { ht->remove_batch(keys, size_t(0), res); })
+    {
+        if (BATCHED)
+        {
+            wargs->ht->remove_batch(wargs->key_list + wargs->start, wargs->end - wargs->start, wargs->result + wargs->start);
+            pthread_exit(nullptr);
+        }
+    }
     for (size_t i = wargs->start; i < wargs->end; ++i)
     {
 #ifdef USE_TBB
-        wargs->result[i] = wargs->tbb_ht->erase(wargs->key_list[i]);
+        wargs->result[i] = wargs->ht->erase(wargs->key_list[i]);
 #else
         wargs->result[i] = wargs->ht->remove(wargs->key_list[i]);
 #endif
@@ -241,14 +285,23 @@ static void *deleteWorker(void *arg)
     return nullptr;
 }
 
+template <typename HT>
 static void *lookupWorker(void *arg)
 {
-    LookupArgs *wargs = static_cast<LookupArgs *>(arg);
+    LookupArgs<HT> *wargs = static_cast<LookupArgs<HT> *>(arg);
+    if constexpr (requires(HT *ht, uint32_t *keys, uint32_t *res) { ht->get_value_batch(keys, size_t(0), res); })
+    {
+        if (BATCHED)
+        {
+            wargs->ht->get_value_batch(wargs->key_list + wargs->start, wargs->end - wargs->start, wargs->result + wargs->start);
+            pthread_exit(nullptr);
+        }
+    }
     for (size_t i = wargs->start; i < wargs->end; ++i)
     {
 #ifdef USE_TBB
         TbbHashTable::const_accessor c_acc;
-        if (wargs->tbb_ht->find(c_acc, wargs->key_list[i]))
+        if (wargs->ht->find(c_acc, wargs->key_list[i]))
         {
             wargs->result[i] = c_acc->second;
         }
@@ -302,17 +355,25 @@ static void run_batch_pthreads(size_t num_items, size_t num_threads, void *(*wor
     }
 }
 
-#ifdef USE_TBB
-void batch_insert(TbbHashTable *tbb_ht, KeyValue *kv_pairs, bool *result, size_t num_pairs)
+template <typename HT>
+void batch_insert(HT *ht, KeyValue *kv_pairs, bool *result, size_t num_pairs, uint32_t *latency_ns = nullptr)
 {
     if (num_pairs == 0)
         return;
+    if constexpr (requires(HT *ht, KeyValue *kv, bool *res) { ht->bulk_load(kv, size_t(0), size_t(1), res); })
+    {
+        if (BULK_LOAD && latency_ns == nullptr)
+        {
+            ht->bulk_load(kv_pairs, num_pairs, NO_THREADS, result);
+            return;
+        }
+    }
     size_t num_threads_actual = std::min((size_t)NO_THREADS, num_pairs);
     if (num_threads_actual == 0)
         num_threads_actual = 1;
 
     std::vector<pthread_t> threads(num_threads_actual);
-    std::vector<InsertArgs> args(num_threads_actual);
+    std::vector<InsertArgs<HT>> args(num_threads_actual);
     size_t chunk_size = num_pairs / num_threads_actual;
     size_t remainder = num_pairs % num_threads_actual;
     size_t current_start = 0;
@@ -322,13 +383,14 @@ void batch_insert(TbbHashTable *tbb_ht, KeyValue *kv_pairs, bool *result, size_t
         size_t current_chunk_size = chunk_size + (t < remainder ? 1 : 0);
         args[t].start = current_start;
         args[t].end = current_start + current_chunk_size;
-        args[t].tbb_ht = tbb_ht;
+        args[t].ht = ht;
         args[t].kv_pairs = kv_pairs;
         args[t].result = result;
+        args[t].latency_ns = latency_ns;
 
         if (current_chunk_size > 0)
         {
-            pthread_create(&threads[t], nullptr, insertWorker, &args[t]);
+            pthread_create(&threads[t], nullptr, insertWorker<HT>, &args[t]);
         }
         else
         {
@@ -343,7 +405,8 @@ void batch_insert(TbbHashTable *tbb_ht, KeyValue *kv_pairs, bool *result, size_t
     }
 }
 
-void batch_delete(TbbHashTable *tbb_ht, uint32_t *key_list, bool *result, size_t num_keys)
+template <typename HT>
+void batch_delete(HT *ht, uint32_t *key_list, bool *result, size_t num_keys)
 {
     if (num_keys == 0)
         return;
@@ -352,7 +415,7 @@ void batch_delete(TbbHashTable *tbb_ht, uint32_t *key_list, bool *result, size_t
         num_threads_actual = 1;
 
     std::vector<pthread_t> threads(num_threads_actual);
-    std::vector<DeleteArgs> args(num_threads_actual);
+    std::vector<DeleteArgs<HT>> args(num_threads_actual);
     size_t chunk_size = num_keys / num_threads_actual;
     size_t remainder = num_keys % num_threads_actual;
     size_t current_start = 0;
@@ -362,13 +425,13 @@ void batch_delete(TbbHashTable *tbb_ht, uint32_t *key_list, bool *result, size_t
         size_t current_chunk_size = chunk_size + (t < remainder ? 1 : 0);
         args[t].start = current_start;
         args[t].end = current_start + current_chunk_size;
-        args[t].tbb_ht = tbb_ht;
+        args[t].ht = ht;
         args[t].key_list = key_list;
         args[t].result = result;
 
         if (current_chunk_size > 0)
         {
-            pthread_create(&threads[t], nullptr, deleteWorker, &args[t]);
+            pthread_create(&threads[t], nullptr, deleteWorker<HT>, &args[t]);
         }
         else
         {
@@ -383,7 +446,8 @@ void batch_delete(TbbHashTable *tbb_ht, uint32_t *key_list, bool *result, size_t
     }
 }
 
-void batch_search(TbbHashTable *tbb_ht, uint32_t *key_list, uint32_t *result, size_t num_keys)
+template <typename HT>
+void batch_search(HT *ht, uint32_t *key_list, uint32_t *result, size_t num_keys)
 {
     if (num_keys == 0)
         return;
@@ -392,7 +456,7 @@ void batch_search(TbbHashTable *tbb_ht, uint32_t *key_list, uint32_t *result, si
         num_threads_actual = 1;
 
     std::vector<pthread_t> threads(num_threads_actual);
-    std::vector<LookupArgs> args(num_threads_actual);
+    std::vector<LookupArgs<HT>> args(num_threads_actual);
     size_t chunk_size = num_keys / num_threads_actual;
     size_t remainder = num_keys % num_threads_actual;
     size_t current_start = 0;
@@ -402,13 +466,13 @@ void batch_search(TbbHashTable *tbb_ht, uint32_t *key_list, uint32_t *result, si
         size_t current_chunk_size = chunk_size + (t < remainder ? 1 : 0);
         args[t].start = current_start;
         args[t].end = current_start + current_chunk_size;
-        args[t].tbb_ht = tbb_ht;
+        args[t].ht = ht;
         args[t].key_list = key_list;
         args[t].result = result;
 
         if (current_chunk_size > 0)
         {
-            pthread_create(&threads[t], nullptr, lookupWorker, &args[t]);
+            pthread_create(&threads[t], nullptr, lookupWorker<HT>, &args[t]);
         }
         else
         {
@@ -422,129 +486,47 @@ void batch_search(TbbHashTable *tbb_ht, uint32_t *key_list, uint32_t *result, si
             pthread_join(threads[t], nullptr);
     }
 }
-
-#else
-
-void batch_insert(HashTable *ht, KeyValue *kv_pairs, bool *result, size_t num_pairs)
+// Tail latency is what a resize shows up in, the averages hide it.
+void print_latency(const char *kernel, uint32_t *latency_ns, size_t n)
 {
-    if (num_pairs == 0)
-        return;
-    size_t num_threads_actual = std::min((size_t)NO_THREADS, num_pairs);
-    if (num_threads_actual == 0)
-        num_threads_actual = 1;
-
-    std::vector<pthread_t> threads(num_threads_actual);
-    std::vector<InsertArgs> args(num_threads_actual);
-    size_t chunk_size = num_pairs / num_threads_actual;
-    size_t remainder = num_pairs % num_threads_actual;
-    size_t current_start = 0;
-
-    for (size_t t = 0; t < num_threads_actual; ++t)
-    {
-        size_t current_chunk_size = chunk_size + (t < remainder ? 1 : 0);
-        args[t].start = current_start;
-        args[t].end = current_start + current_chunk_size;
-        args[t].ht = ht;
-        args[t].kv_pairs = kv_pairs;
-        args[t].result = result;
-
-        if (current_chunk_size > 0)
-        {
-            pthread_create(&threads[t], nullptr, insertWorker, &args[t]);
-        }
-        else
-        {
-            threads[t] = 0;
-        }
-        current_start += current_chunk_size;
-    }
-    for (size_t t = 0; t < num_threads_actual; ++t)
-    {
-        if (threads[t] != 0)
-            pthread_join(threads[t], nullptr);
-    }
+    std::vector<uint32_t> sorted(latency_ns, latency_ns + n);
+    std::sort(sorted.begin(), sorted.end());
+    auto pct = [&](double p)
+    { return sorted[std::min(n - 1, (size_t)(p * n))] / 1000.0; };
+    cout << kernel << " latency (us) p50: " << pct(0.5) << " p99: " << pct(0.99)
+         << " p99.9: " << pct(0.999) << " max: " << sorted[n - 1] / 1000.0 << "\n";
 }
 
-void batch_delete(HashTable *ht, uint32_t *key_list, bool *result, size_t num_keys)
+#ifndef USE_TBB
+// A restart from a snapshot: writing it, rebuilding a table from it, and mapping it
+// to serve lookups in place.
+template <typename Hash>
+void snapshot_round_trip(BasicHashTable<Hash> *ht, path pth)
 {
-    if (num_keys == 0)
+    HRTimer start = HR::now();
+    if (!ht->save(pth.string().c_str()))
         return;
-    size_t num_threads_actual = std::min((size_t)NO_THREADS, num_keys);
-    if (num_threads_actual == 0)
-        num_threads_actual = 1;
-
-    std::vector<pthread_t> threads(num_threads_actual);
-    std::vector<DeleteArgs> args(num_threads_actual);
-    size_t chunk_size = num_keys / num_threads_actual;
-    size_t remainder = num_keys % num_threads_actual;
-    size_t current_start = 0;
-
-    for (size_t t = 0; t < num_threads_actual; ++t)
-    {
-        size_t current_chunk_size = chunk_size + (t < remainder ? 1 : 0);
-        args[t].start = current_start;
-        args[t].end = current_start + current_chunk_size;
-        args[t].ht = ht;
-        args[t].key_list = key_list;
-        args[t].result = result;
-
-        if (current_chunk_size > 0)
-        {
-            pthread_create(&threads[t], nullptr, deleteWorker, &args[t]);
-        }
-        else
-        {
-            threads[t] = 0;
-        }
-        current_start += current_chunk_size;
-    }
-    for (size_t t = 0; t < num_threads_actual; ++t)
-    {
-        if (threads[t] != 0)
-            pthread_join(threads[t], nullptr);
-    }
+    HRTimer saved = HR::now();
+    BasicHashTable<Hash> *loaded = BasicHashTable<Hash>::load(pth.string().c_str(), NO_THREADS, STRIPES);
+    HRTimer done = HR::now();
+    SnapshotView<Hash> view(pth.string().c_str());
+    HRTimer mapped = HR::now();
+    cout << "Snapshot save (ms): " << duration_cast<milliseconds>(saved - start).count()
+         << " load (ms): " << duration_cast<milliseconds>(done - saved).count()
+         << " map (us): " << duration_cast<microseconds>(mapped - done).count() << "\n";
+    if (loaded == nullptr || loaded->size() != ht->size() || view.size() != ht->size())
+        cout << "Snapshot does not match the table\n";
+    delete loaded;
+    std::filesystem::remove(pth);
 }
+#endif
 
-void batch_search(HashTable *ht, uint32_t *key_list, uint32_t *result, size_t num_keys)
+// Bytes of heap in use, including big blocks malloc got straight from mmap.
+static size_t heap_in_use()
 {
-    if (num_keys == 0)
-        return;
-    size_t num_threads_actual = std::min((size_t)NO_THREADS, num_keys);
-    if (num_threads_actual == 0)
-        num_threads_actual = 1;
-
-    std::vector<pthread_t> threads(num_threads_actual);
-    std::vector<LookupArgs> args(num_threads_actual);
-    size_t chunk_size = num_keys / num_threads_actual;
-    size_t remainder = num_keys % num_threads_actual;
-    size_t current_start = 0;
-
-    for (size_t t = 0; t < num_threads_actual; ++t)
-    {
-        size_t current_chunk_size = chunk_size + (t < remainder ? 1 : 0);
-        args[t].start = current_start;
-        args[t].end = current_start + current_chunk_size;
-        args[t].ht = ht;
-        args[t].key_list = key_list;
-        args[t].result = result;
-
-        if (current_chunk_size > 0)
-        {
-            pthread_create(&threads[t], nullptr, lookupWorker, &args[t]);
-        }
-        else
-        {
-            threads[t] = 0;
-        }
-        current_start += current_chunk_size;
-    }
-    for (size_t t = 0; t < num_threads_actual; ++t)
-    {
-        if (threads[t] != 0)
-            pthread_join(threads[t], nullptr);
-    }
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
 }
-#endif // USE_TBB
 
 int main(int argc, char *argv[])
 {
@@ -565,7 +547,34 @@ int main(int argc, char *argv[])
 #ifdef USE_TBB
     cout << "Using TBB concurrent_hash_map" << endl;
 #else
-    cout << "Using custom HashTable" << endl;
+    if (TABLE_IMPL == 1)
+    {
+        cout << "Using custom open addressing HashTable" << endl;
+    }
+    else if (TABLE_IMPL == 2)
+    {
+        cout << "Using custom cuckoo HashTable" << endl;
+    }
+    else if (TABLE_IMPL == 3)
+    {
+        cout << "Using custom split-ordered HashTable" << endl;
+    }
+    else if (TABLE_IMPL == 4)
+    {
+        cout << "Using custom lock-free chained HashTable" << endl;
+    }
+    else if (TABLE_IMPL == 5)
+    {
+        cout << "Using custom swiss HashTable" << endl;
+    }
+    else if (TABLE_IMPL == 6)
+    {
+        cout << "Using custom sharded HashTable, " << SHARDS << " shards" << endl;
+    }
+    else
+    {
+        cout << "Using custom HashTable" << endl;
+    }
 #endif
     cout << "Threads: " << NO_THREADS << " Runs: " << runs << "\n";
     cout << "NUM OPS: " << NUM_OPS << " ADD: " << ADD << " REM: " << REM
@@ -575,6 +584,7 @@ int main(int argc, char *argv[])
     uint32_t *h_keys_del = nullptr;
     uint32_t *h_keys_lookup = nullptr;
     bool *add_result = nullptr;
+    uint32_t *add_latency = nullptr;
     bool *del_result = nullptr;
     uint32_t *find_result = nullptr;
 
@@ -583,6 +593,8 @@ int main(int argc, char *argv[])
         h_kvs_insert = new KeyValue[ADD];
         memset(h_kvs_insert, 0, sizeof(KeyValue) * ADD);
         add_result = new bool[ADD];
+        if (LATENCY)
+            add_latency = new uint32_t[ADD];
     }
     if (REM > 0)
     {
@@ -637,23 +649,23 @@ int main(int argc, char *argv[])
     HRTimer start, end;
     uint32_t del_runs = 0, search_runs = 0;
 
-    for (uint32_t i = 0; i < runs; i++)
+    size_t heap_before = 0;
+    auto run_kernels = [&](auto *the_hash_table)
     {
-#ifdef USE_TBB
-        TbbHashTable *the_hash_table = new TbbHashTable();
-#else
-        size_t capacity = 2e5; // initial capacity
-        HashTable *the_hash_table = new HashTable(capacity);
-#endif
-
         if (ADD > 0)
         {
             memset(add_result, 0, sizeof(bool) * ADD);
             start = HR::now();
-            batch_insert(the_hash_table, h_kvs_insert, add_result, ADD);
+            batch_insert(the_hash_table, h_kvs_insert, add_result, ADD, add_latency);
             end = HR::now();
             float iter_insert_time = duration_cast<milliseconds>(end - start).count();
             total_insert_time += iter_insert_time;
+            if (add_latency != nullptr)
+                print_latency("Insert", add_latency, ADD);
+            // everything the table holds came from the heap since heap_before
+            size_t entries = std::count(add_result, add_result + ADD, true);
+            if (entries > 0)
+                cout << "Memory per entry (bytes): " << (double)(heap_in_use() - heap_before) / entries << "\n";
         }
 
         if (REM > 0)
@@ -677,6 +689,81 @@ int main(int argc, char *argv[])
             total_search_time += iter_search_time;
             search_runs++;
         }
+    };
+
+    for (uint32_t i = 0; i < runs; i++)
+    {
+        heap_before = heap_in_use();
+#ifdef USE_TBB
+        TbbHashTable *the_hash_table = new TbbHashTable();
+        run_kernels(the_hash_table);
+        delete the_hash_table;
+#else
+        size_t capacity = 2e5; // initial capacity
+        if (TABLE_IMPL == 1)
+        {
+            OAHashTable *the_hash_table = new OAHashTable(capacity);
+            run_kernels(the_hash_table);
+            delete the_hash_table;
+        }
+        else if (TABLE_IMPL == 2)
+        {
+            CuckooHashTable *the_hash_table = new CuckooHashTable(capacity);
+            run_kernels(the_hash_table);
+            delete the_hash_table;
+        }
+        else if (TABLE_IMPL == 3)
+        {
+            SplitOrderedHashTable *the_hash_table = new SplitOrderedHashTable(capacity);
+            run_kernels(the_hash_table);
+            delete the_hash_table;
+        }
+        else if (TABLE_IMPL == 4)
+        {
+            LockFreeHashTable *the_hash_table = new LockFreeHashTable(capacity);
+            run_kernels(the_hash_table);
+            delete the_hash_table;
+        }
+        else if (TABLE_IMPL == 5)
+        {
+            SwissHashTable *the_hash_table = new SwissHashTable(capacity);
+            run_kernels(the_hash_table);
+            delete the_hash_table;
+        }
+        else
+        {
+            auto run_chained = [&]<typename Hash>(Hash)
+            {
+                if (TABLE_IMPL == 6)
+                {
+                    auto *the_hash_table = new BasicShardedHashTable<Hash>(capacity, SHARDS, STRIPES, NUMA);
+                    run_kernels(the_hash_table);
+                    delete the_hash_table;
+                    return;
+                }
+                BasicHashTable<Hash> *the_hash_table = new BasicHashTable<Hash>(capacity, STRIPES);
+                run_kernels(the_hash_table);
+                if (SNAPSHOT)
+                    snapshot_round_trip(the_hash_table, cwd / "hash_table.snap");
+                delete the_hash_table;
+            };
+            switch (HASH_POLICY)
+            {
+            case 1:
+                run_chained(IdentityHash());
+                break;
+            case 2:
+                run_chained(MurmurHash());
+                break;
+            case 3:
+                run_chained(Crc32Hash());
+                break;
+            default:
+                run_chained(FibonacciHash());
+                break;
+            }
+        }
+#endif
 
         cout << "Run " << (i + 1) << " completed." << endl;
     }
@@ -693,12 +780,15 @@ int main(int argc, char *argv[])
     if (search_runs > 0)
     {
         cout << "Avg time taken by search kernel (ms): " << total_search_time / search_runs << "\n";
+        if (total_search_time > 0)
+            cout << "Search throughput (Mops/s): " << FIND * search_runs / total_search_time / 1000 << "\n";
     }
 
     delete[] h_kvs_insert;
     delete[] h_keys_del;
     delete[] h_keys_lookup;
     delete[] add_result;
+    delete[] add_latency;
     delete[] del_result;
     delete[] find_result;
     return 0;
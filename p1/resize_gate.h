@@ -0,0 +1,77 @@
+// resize_gate.h
+#ifndef RESIZE_GATE_H
+#define RESIZE_GATE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include "sharded_counter.h"
+
+// Lets operations run without a lock while no resize is going on. An operation
+// announces itself in one of SHARDS counters, so entering touches a line shared
+// with few other threads, unlike a reader-writer lock. close() shuts the gate and
+// waits until every operation inside has left.
+class ResizeGate
+{
+private:
+    static constexpr size_t SHARDS = 64;
+
+    struct alignas(64) Counter
+    {
+        std::atomic<size_t> n;
+        Counter() : n(0) {}
+    };
+
+    Counter inside[SHARDS];
+    std::atomic<bool> closed;
+
+public:
+    ResizeGate() : closed(false) {}
+
+    // Returns the counter to hand to leave(), or nullptr if the gate is closed.
+    std::atomic<size_t> *enter()
+    {
+        // announce first, then check: close() sets the flag first, then checks the counters
+        std::atomic<size_t> &n = inside[thread_slot() % SHARDS].n;
+        n.fetch_add(1);
+        if (!closed.load())
+            return &n;
+        n.fetch_sub(1, std::memory_order_release);
+        return nullptr;
+    }
+
+    void leave(std::atomic<size_t> *n)
+    {
+        n->fetch_sub(1, std::memory_order_release);
+    }
+
+    // Closes the gate and waits for everyone inside. Returns false, without waiting,
+    // if somebody else closed it already.
+    bool close()
+    {
+        bool expected = false;
+        if (!closed.compare_exchange_strong(expected, true))
+            return false;
+        // seq_cst, like the fetch_add and the flag load in enter(): with an acquire load
+        // both sides could miss each other's write (store buffering), and a writer would
+        // run lock-free while the resize copies its generation.
+        for (Counter &c : inside)
+        {
+            while (c.n.load() != 0)
+                std::this_thread::yield();
+        }
+        return true;
+    }
+
+    void open()
+    {
+        closed.store(false);
+    }
+
+    bool is_closed() const
+    {
+        return closed.load();
+    }
+};
+
+#endif
@@ -0,0 +1,53 @@
+// resize_policy.h
+#ifndef RESIZE_POLICY_H
+#define RESIZE_POLICY_H
+
+#include <stddef.h>
+
+// When BasicHashTable changes its bucket count, in average entries per bucket.
+// It grows above max_load and shrinks below min_load, and either way lands on the
+// power of 2 that puts the load in [target_load, 2 * target_load). The gap between
+// that range and the thresholds is the hysteresis: after a resize a large share of
+// the entries has to come or go before the next one.
+struct ResizePolicy
+{
+    // Buckets hold 6 entries in their first line, so at this load few of them need an overflow line.
+    double max_load = 4.0;
+    double min_load = 0.5;
+    double target_load = 2.0;
+
+    bool valid() const
+    {
+        return min_load >= 0 && min_load < target_load && 2 * target_load <= max_load;
+    }
+
+    bool too_full(size_t size, size_t buckets) const
+    {
+        return size > max_load * buckets;
+    }
+
+    bool too_empty(size_t size, size_t buckets) const
+    {
+        return size < min_load * buckets;
+    }
+
+    // bucket count that puts size entries at target_load
+    size_t target_buckets(size_t size) const
+    {
+        size_t p = 1;
+        while (2 * p <= size / target_load)
+            p <<= 1;
+        return p;
+    }
+
+    // fewest buckets that hold size entries without growing
+    size_t min_buckets(size_t size) const
+    {
+        size_t p = 1;
+        while (p * max_load < size)
+            p <<= 1;
+        return p;
+    }
+};
+
+#endif
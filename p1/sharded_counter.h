@@ -0,0 +1,74 @@
+// sharded_counter.h
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Small per-thread index, handed out round robin the first time a thread asks.
+inline size_t thread_slot()
+{
+    static std::atomic<size_t> next_id(0);
+    static thread_local size_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+// Counter that writers update on their own cache line, like Linux's percpu_counter.
+// A thread's delta is folded into the shared total once it reaches fold_at, so the
+// total is off by less than fold_at per thread and only sees every fold_at-th update.
+class ShardedCounter
+{
+private:
+    static constexpr size_t SHARDS = 64;
+
+    struct alignas(64) Shard
+    {
+        std::atomic<int64_t> delta;
+        Shard() : delta(0) {}
+    };
+
+    Shard shards[SHARDS];
+    alignas(64) std::atomic<int64_t> total;
+    std::atomic<int64_t> fold_at;
+
+public:
+    ShardedCounter() : total(0), fold_at(1) {}
+
+    // Returns true if this call moved the total, the time to look at it again.
+    bool add(int64_t n)
+    {
+        std::atomic<int64_t> &d = shards[thread_slot() % SHARDS].delta;
+        int64_t v = d.fetch_add(n, std::memory_order_relaxed) + n;
+        int64_t f = fold_at.load(std::memory_order_relaxed);
+        if (v < f && v > -f)
+            return false;
+        total.fetch_add(d.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        return true;
+    }
+
+    // Trades accuracy for fewer writes to the shared line: 1 folds every update.
+    void set_fold(int64_t f)
+    {
+        fold_at.store(f > 0 ? f : 1, std::memory_order_relaxed);
+    }
+
+    // One load, off by less than the fold per writing thread. Can be negative for a moment.
+    int64_t approx() const
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    // Adds up every shard, exact once the writers are done.
+    int64_t sum() const
+    {
+        int64_t s = total.load(std::memory_order_relaxed);
+        for (const Shard &sh : shards)
+        {
+            s += sh.delta.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+};
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef USE_TBB
+#include "sharded_hash_table.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+// CPUs of every NUMA node, from sysfs. Empty if the kernel doesn't say.
+static std::vector<cpu_set_t> numa_node_cpus()
+{
+    std::vector<cpu_set_t> nodes;
+    for (int node = 0;; ++node)
+    {
+        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        FILE *fptr = fopen(path.c_str(), "r");
+        if (!fptr)
+            break;
+        // "0-3,8-11"
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        int lo, hi;
+        while (fscanf(fptr, "%d", &lo) == 1)
+        {
+            hi = lo;
+            int c = fgetc(fptr);
+            if (c == '-')
+            {
+                if (fscanf(fptr, "%d", &hi) != 1)
+                    break;
+                c = fgetc(fptr);
+            }
+            for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; ++cpu)
+                CPU_SET(cpu, &cpus);
+            if (c != ',')
+                break;
+        }
+        fclose(fptr);
+        if (CPU_COUNT(&cpus) > 0)
+            nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+// Stable counting sort of n items by shard: the indices of shard s end up in
+// order[start[s] .. start[s + 1]), still in input order.
+template <typename ShardOf>
+static void group_by_shard(size_t n, size_t num_shards, ShardOf shard_of,
+                           std::vector<size_t> &start, std::vector<size_t> &order)
+{
+    start.assign(num_shards + 1, 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        start[shard_of(i) + 1]++;
+    }
+    for (size_t s = 0; s < num_shards; ++s)
+    {
+        start[s + 1] += start[s];
+    }
+    std::vector<size_t> pos(start.begin(), start.end() - 1);
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        order[pos[shard_of(i)]++] = i;
+    }
+}
+
+template <typename Hash>
+BasicShardedHashTable<Hash>::BasicShardedHashTable(size_t cap, size_t num_shards, size_t num_stripes, bool numa,
+                                                   ResizePolicy resize_policy)
+{
+    num_shards = std::clamp<size_t>(round_up_pow2(num_shards), 1, 1 << 16);
+    shard_bits = __builtin_ctzll(num_shards);
+    if (num_stripes == 0)
+        num_stripes = STRIPES_PER_THREAD * std::max(1u, std::thread::hardware_concurrency());
+    size_t stripes_per_shard = std::max<size_t>(num_stripes / num_shards, 1);
+    size_t cap_per_shard = (cap + num_shards - 1) / num_shards;
+
+    shards.resize(num_shards);
+    // One pool for all shards: a thread caches lines of one pool at a time, and writes
+    // that hop between shards would hand the cache back on every hop.
+    std::shared_ptr<LinePool> pool = std::make_shared<LinePool>();
+    auto build = [&](size_t s)
+    {
+        shards[s].reset(new BasicHashTable<Hash>(cap_per_shard, stripes_per_shard, resize_policy, pool));
+    };
+    std::vector<cpu_set_t> nodes;
+    if (numa)
+        nodes = numa_node_cpus();
+    if (nodes.size() < 2)
+    {
+        for (size_t s = 0; s < num_shards; ++s)
+        {
+            build(s);
+        }
+        return;
+    }
+    // One builder per node: its buckets are first touched there, and Linux backs them with local pages.
+    std::vector<std::thread> builders;
+    for (size_t node = 0; node < nodes.size(); ++node)
+    {
+        builders.emplace_back([&, node]()
+                              {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &nodes[node]);
+            for (size_t s = node; s < num_shards; s += nodes.size())
+            {
+                build(s);
+            } });
+    }
+    for (std::thread &t : builders)
+    {
+        t.join();
+    }
+}
+
+template <typename Hash>
+size_t BasicShardedHashTable<Hash>::size() const
+{
+    size_t total = 0;
+    for (const auto &shard : shards)
+    {
+        total += shard->size();
+    }
+    return total;
+}
+
+template <typename Hash>
+void BasicShardedHashTable<Hash>::reserve(size_t n)
+{
+    for (auto &shard : shards)
+    {
+        shard->reserve((n + shards.size() - 1) / shards.size());
+    }
+}
+
+template <typename Hash>
+void BasicShardedHashTable<Hash>::shrink_to_fit()
+{
+    for (auto &shard : shards)
+    {
+        shard->shrink_to_fit();
+    }
+}
+
+template <typename Hash>
+void BasicShardedHashTable<Hash>::insert_batch(const KeyValue *kv_pairs, size_t n, bool *result)
+{
+    if (shards.size() == 1)
+        return shards[0]->insert_batch(kv_pairs, n, result);
+    std::vector<size_t> start, order;
+    group_by_shard(n, shards.size(), [&](size_t i)
+                   { return shard_index(kv_pairs[i].key); }, start, order);
+    std::vector<KeyValue> part(n);
+    std::unique_ptr<bool[]> part_result(new bool[n]);
+    for (size_t k = 0; k < n; ++k)
+    {
+        part[k] = kv_pairs[order[k]];
+    }
+    for (size_t s = 0; s < shards.size(); ++s)
+    {
+        if (start[s] != start[s + 1])
+            shards[s]->insert_batch(&part[start[s]], start[s + 1] - start[s], &part_result[start[s]]);
+    }
+    for (size_t k = 0; k < n; ++k)
+    {
+        result[order[k]] = part_result[k];
+    }
+}
+
+template <typename Hash>
+void BasicShardedHashTable<Hash>::remove_batch(const uint32_t *keys, size_t n, bool *result)
+{
+    if (shards.size() == 1)
+        return shards[0]->remove_batch(keys, n, result);
+    std::vector<size_t> start, order;
+    group_by_shard(n, shards.size(), [&](size_t i)
+                   { return shard_index(keys[i]); }, start, order);
+    std::vector<uint32_t> part(n);
+    std::unique_ptr<bool[]> part_result(new bool[n]);
+    for (size_t k = 0; k < n; ++k)
+    {
+        part[k] = keys[order[k]];
+    }
+    for (size_t s = 0; s < shards.size(); ++s)
+    {
+        if (start[s] != start[s + 1])
+            shards[s]->remove_batch(&part[start[s]], start[s + 1] - start[s], &part_result[start[s]]);
+    }
+    for (size_t k = 0; k < n; ++k)
+    {
+        result[order[k]] = part_result[k];
+    }
+}
+
+template <typename Hash>
+void BasicShardedHashTable<Hash>::get_value_batch(const uint32_t *keys, size_t n, uint32_t *values, bool *found)
+{
+    if (shards.size() == 1)
+        return shards[0]->get_value_batch(keys, n, values, found);
+    std::vector<size_t> start, order;
+    group_by_shard(n, shards.size(), [&](size_t i)
+                   { return shard_index(keys[i]); }, start, order);
+    std::vector<uint32_t> part(n), part_values(n);
+    std::unique_ptr<bool[]> part_found(new bool[n]);
+    for (size_t k = 0; k < n; ++k)
+    {
+        part[k] = keys[order[k]];
+    }
+    for (size_t s = 0; s < shards.size(); ++s)
+    {
+        if (start[s] != start[s + 1])
+            shards[s]->get_value_batch(&part[start[s]], start[s + 1] - start[s], &part_values[start[s]], &part_found[start[s]]);
+    }
+    for (size_t k = 0; k < n; ++k)
+    {
+        values[order[k]] = part_values[k];
+        if (found != nullptr)
+            found[order[k]] = part_found[k];
+    }
+}
+
+template <typename Hash>
+size_t BasicShardedHashTable<Hash>::bulk_load(const KeyValue *kv_pairs, size_t n, size_t threads, bool *result)
+{
+    if (shards.size() == 1)
+        return shards[0]->bulk_load(kv_pairs, n, threads, result);
+    std::vector<size_t> start, order;
+    group_by_shard(n, shards.size(), [&](size_t i)
+                   { return shard_index(kv_pairs[i].key); }, start, order);
+    std::vector<KeyValue> part(n);
+    std::unique_ptr<bool[]> part_result(new bool[n]);
+    for (size_t k = 0; k < n; ++k)
+    {
+        part[k] = kv_pairs[order[k]];
+    }
+    size_t total = 0;
+    for (size_t s = 0; s < shards.size(); ++s)
+    {
+        if (start[s] != start[s + 1])
+            total += shards[s]->bulk_load(&part[start[s]], start[s + 1] - start[s], threads, &part_result[start[s]]);
+    }
+    if (result != nullptr)
+    {
+        for (size_t k = 0; k < n; ++k)
+        {
+            result[order[k]] = part_result[k];
+        }
+    }
+    return total;
+}
+
+template class BasicShardedHashTable<IdentityHash>;
+template class BasicShardedHashTable<FibonacciHash>;
+template class BasicShardedHashTable<MurmurHash>;
+template class BasicShardedHashTable<Crc32Hash>;
+
+#endif
@@ -0,0 +1,115 @@
+// sharded_hash_table.h
+#ifndef SHARDED_HASH_TABLE_H
+#define SHARDED_HASH_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "key_value.h"
+#include "hash_policy.h"
+#include "resize_policy.h"
+#include "hash_table.h"
+
+// Independent BasicHashTables behind one front end. A key's shard is the top bits
+// of its 32-bit hash, while a shard picks buckets and stripes from the low bits, so
+// the two stay unrelated. Every shard has its own stripes, size counter and resizes:
+// a resize only holds up the keys of its own shard, and writers to different shards
+// share no cache lines in the common case. Only the pool of overflow lines is shared,
+// threads take and give back lines in batches. With IdentityHash the top bits are the top bits of the key,
+// so small keys all go to shard 0.
+template <typename Hash>
+class BasicShardedHashTable
+{
+private:
+    // Default number of stripes per hardware thread, spread over all shards.
+    static constexpr size_t STRIPES_PER_THREAD = 32;
+
+    std::vector<std::unique_ptr<BasicHashTable<Hash>>> shards;
+    int shard_bits;
+
+    size_t shard_index(unsigned int key) const
+    {
+        return (Hash{}(key) & 0xFFFFFFFF) >> (32 - shard_bits);
+    }
+
+public:
+    // cap entries in total before the first resize, spread over num_shards shards
+    // (rounded up to a power of 2). num_stripes is the total number of locks, 0 picks
+    // STRIPES_PER_THREAD per hardware thread. With numa set, shard i is built by a
+    // thread running on NUMA node i % nodes, so that its buckets are allocated there;
+    // overflow lines and later generations are placed by whichever thread needs them.
+    BasicShardedHashTable(size_t cap, size_t num_shards = 16, size_t num_stripes = 0, bool numa = false,
+                          ResizePolicy resize_policy = ResizePolicy());
+
+    size_t num_shards() const { return shards.size(); }
+
+    bool contains(unsigned int key) { return shards[shard_index(key)]->contains(key); }
+
+    bool insert(unsigned int key, unsigned int val) { return shards[shard_index(key)]->insert(key, val); }
+
+    bool remove(unsigned int key) { return shards[shard_index(key)]->remove(key); }
+
+    std::pair<bool, unsigned int> get_value(unsigned int key) { return shards[shard_index(key)]->get_value(key); }
+
+    // Sum over the shards, exact while no writer is running.
+    size_t size() const;
+
+    // Every shard gets its share of n, plus the same floor against shrinking.
+    void reserve(size_t n);
+
+    void shrink_to_fit();
+
+    // Same as the BasicHashTable batch calls. Keys are grouped by shard, keeping their
+    // order, and each group goes to its shard's batch call.
+    void insert_batch(const KeyValue *kv_pairs, size_t n, bool *result);
+
+    void remove_batch(const uint32_t *keys, size_t n, bool *result);
+
+    void get_value_batch(const uint32_t *keys, size_t n, uint32_t *values, bool *found = nullptr);
+
+    // Shard by shard bulk_load of the pairs, each with all threads threads.
+    size_t bulk_load(const KeyValue *kv_pairs, size_t n, size_t threads, bool *result = nullptr);
+
+    template <typename Fn>
+    bool upsert(unsigned int key, Fn fn)
+    {
+        return shards[shard_index(key)]->upsert(key, fn);
+    }
+
+    unsigned int fetch_add(unsigned int key, unsigned int delta)
+    {
+        return shards[shard_index(key)]->fetch_add(key, delta);
+    }
+
+    bool insert_or_assign(unsigned int key, unsigned int val)
+    {
+        return shards[shard_index(key)]->insert_or_assign(key, val);
+    }
+
+    template <typename Pred>
+    bool erase_if(unsigned int key, Pred pred)
+    {
+        return shards[shard_index(key)]->erase_if(key, pred);
+    }
+
+    // Calls fn(key, value) for every entry, shard after shard, see BasicHashTable::parallel_for_each.
+    template <typename Fn>
+    void parallel_for_each(Fn fn, size_t threads)
+    {
+        for (auto &shard : shards)
+        {
+            shard->parallel_for_each(fn, threads);
+        }
+    }
+};
+
+extern template class BasicShardedHashTable<IdentityHash>;
+extern template class BasicShardedHashTable<FibonacciHash>;
+extern template class BasicShardedHashTable<MurmurHash>;
+extern template class BasicShardedHashTable<Crc32Hash>;
+
+using ShardedHashTable = BasicShardedHashTable<FibonacciHash>;
+
+#endif
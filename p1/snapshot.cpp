@@ -0,0 +1,126 @@
+#ifndef USE_TBB
+#include "snapshot.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+// Lookups index entries with the offsets unchecked, so every bucket has to be a range
+// inside entries[0 .. size).
+static bool offsets_valid(const uint64_t *offsets, uint64_t capacity, uint64_t size)
+{
+    if (offsets[0] != 0 || offsets[capacity] != size)
+        return false;
+    for (uint64_t p = 0; p < capacity; ++p)
+    {
+        if (offsets[p + 1] < offsets[p])
+            return false;
+    }
+    return true;
+}
+
+bool SnapshotMapping::open(const char *path, uint64_t hash_check)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        std::string error_msg = std::string("Unable to open snapshot: ") + path;
+        perror(error_msg.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader))
+    {
+        fprintf(stderr, "Not a snapshot: %s\n", path);
+        ::close(fd);
+        return false;
+    }
+    length = st.st_size;
+    base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        base = nullptr;
+        std::string error_msg = std::string("Unable to map snapshot: ") + path;
+        perror(error_msg.c_str());
+        return false;
+    }
+
+    const SnapshotHeader *h = static_cast<const SnapshotHeader *>(base);
+    const char *problem = nullptr;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || h->version != SNAPSHOT_VERSION)
+        problem = "not a snapshot of this version";
+    else if (h->hash_check != hash_check)
+        problem = "written with another hash policy";
+    else if (h->capacity == 0 || (h->capacity & (h->capacity - 1)) != 0 || h->stripes == 0 ||
+             (h->stripes & (h->stripes - 1)) != 0 || h->stripes > h->capacity)
+        problem = "bad geometry";
+    else if (h->capacity >= (length - sizeof(SnapshotHeader)) / sizeof(uint64_t) ||
+             h->size > (length - sizeof(SnapshotHeader) - (h->capacity + 1) * sizeof(uint64_t)) / sizeof(KeyValue))
+        problem = "truncated"; // checked first, so that the sizes below can't overflow
+    else if (length != sizeof(SnapshotHeader) + (h->capacity + 1) * sizeof(uint64_t) + h->size * sizeof(KeyValue))
+        problem = "truncated";
+    else if (!offsets_valid(reinterpret_cast<const uint64_t *>(h + 1), h->capacity, h->size))
+        problem = "bad offsets";
+    if (problem != nullptr)
+    {
+        fprintf(stderr, "Snapshot %s: %s\n", path, problem);
+        close();
+        return false;
+    }
+
+    header = h;
+    offsets = reinterpret_cast<const uint64_t *>(h + 1);
+    entries = reinterpret_cast<const KeyValue *>(offsets + h->capacity + 1);
+    return true;
+}
+
+void SnapshotMapping::close()
+{
+    if (base != nullptr)
+        munmap(base, length);
+    base = nullptr;
+    header = nullptr;
+}
+
+template <typename Hash>
+SnapshotView<Hash>::SnapshotView(const char *path)
+{
+    map.open(path, snapshot_hash_check<Hash>());
+}
+
+template <typename Hash>
+SnapshotView<Hash>::~SnapshotView()
+{
+    map.close();
+}
+
+template <typename Hash>
+bool SnapshotView<Hash>::contains(unsigned int key) const
+{
+    return get_value(key).first;
+}
+
+template <typename Hash>
+std::pair<bool, unsigned int> SnapshotView<Hash>::get_value(unsigned int key) const
+{
+    if (!valid())
+        return {false, 0};
+    size_t p = map.position(Hash{}(key) & (map.header->capacity - 1));
+    for (uint64_t i = map.offsets[p]; i < map.offsets[p + 1]; ++i)
+    {
+        if (map.entries[i].key == key)
+            return {true, map.entries[i].value};
+    }
+    return {false, 0}; // return 0 for failed search.
+}
+
+template class SnapshotView<IdentityHash>;
+template class SnapshotView<FibonacciHash>;
+template class SnapshotView<MurmurHash>;
+template class SnapshotView<Crc32Hash>;
+
+#endif
@@ -0,0 +1,92 @@
+// snapshot.h
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include "key_value.h"
+#include "hash_policy.h"
+
+// On-disk image of a chained table, written by BasicHashTable::save. It holds no
+// pointers, so it can be mapped and read in place:
+//
+//   SnapshotHeader
+//   uint64_t offsets[capacity + 1]   entries of bucket position p are offsets[p] .. offsets[p + 1]
+//   KeyValue entries[size]
+//
+// Bucket positions are stripe major, position (i % stripes) * (capacity / stripes) + i / stripes
+// for bucket i, so every stripe is one contiguous run of the file.
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t hash_check; // the hash policy the buckets were laid out with, see snapshot_hash_check
+    uint64_t capacity;   // buckets, a power of 2
+    uint64_t stripes;    // a power of 2 no larger than capacity
+    uint64_t size;       // entries
+};
+
+static constexpr char SNAPSHOT_MAGIC[8] = {'H', 'T', 'S', 'N', 'A', 'P', '\0', '\0'};
+static constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+// A file only fits a table with the same hash policy. Hashes of two fixed keys
+// tell the policies apart without giving them names.
+template <typename Hash>
+uint64_t snapshot_hash_check()
+{
+    return (static_cast<uint64_t>(Hash{}(0x9E3779B9u)) << 32) ^ Hash{}(0x7F4A7C15u);
+}
+
+// Mapped snapshot file: the header and where its two arrays start.
+struct SnapshotMapping
+{
+    void *base = nullptr;
+    size_t length = 0;
+    const SnapshotHeader *header = nullptr;
+    const uint64_t *offsets = nullptr;
+    const KeyValue *entries = nullptr;
+
+    // Maps path read-only and checks that it is a snapshot laid out with hash_check.
+    // Prints the reason and returns false if it isn't.
+    bool open(const char *path, uint64_t hash_check);
+    void close();
+
+    size_t position(size_t bucket) const
+    {
+        size_t per_stripe = header->capacity / header->stripes;
+        return (bucket & (header->stripes - 1)) * per_stripe + bucket / header->stripes;
+    }
+};
+
+// Read-only table served straight from a mapped snapshot. Opening it costs one
+// mmap, pages are faulted in as lookups touch them.
+template <typename Hash>
+class SnapshotView
+{
+private:
+    SnapshotMapping map;
+
+public:
+    explicit SnapshotView(const char *path);
+    ~SnapshotView();
+    SnapshotView(const SnapshotView &) = delete;
+    SnapshotView &operator=(const SnapshotView &) = delete;
+
+    // false if the file could not be mapped or does not fit Hash
+    bool valid() const { return map.header != nullptr; }
+
+    size_t size() const { return valid() ? map.header->size : 0; }
+
+    bool contains(unsigned int key) const;
+
+    std::pair<bool, unsigned int> get_value(unsigned int key) const;
+};
+
+extern template class SnapshotView<IdentityHash>;
+extern template class SnapshotView<FibonacciHash>;
+extern template class SnapshotView<MurmurHash>;
+extern template class SnapshotView<Crc32Hash>;
+
+#endif
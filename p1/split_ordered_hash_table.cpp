@@ -0,0 +1,135 @@
+#ifndef USE_TBB
+#include "split_ordered_hash_table.h"
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t cap = 1;
+    while (cap < n)
+        cap <<= 1;
+    return cap;
+}
+
+uint32_t SplitOrderedHashTable::reverse_bits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+    return __builtin_bswap32(x);
+}
+
+SplitOrderedHashTable::SplitOrderedHashTable(size_t cap)
+    : bucket_count(round_up_pow2(cap / MAX_LOAD + 1)), size(0)
+{
+    for (int s = 0; s < MAX_SEGMENTS; ++s)
+    {
+        segments[s].store(nullptr, std::memory_order_relaxed);
+    }
+    // bucket 0 starts the whole list, every other sentinel hangs off it
+    bucket_slot(0).store(new MarkedNode(sentinel_order(0), 0, 0), std::memory_order_release);
+}
+
+SplitOrderedHashTable::~SplitOrderedHashTable()
+{
+    // every node still linked, sentinels included, is reachable from bucket 0
+    MarkedNode *n = bucket_slot(0).load();
+    while (n != nullptr)
+    {
+        MarkedNode *next = n->next.load().getPointer();
+        delete n;
+        n = next;
+    }
+    for (int s = 0; s < MAX_SEGMENTS; ++s)
+    {
+        delete[] segments[s].load();
+    }
+}
+
+std::atomic<MarkedNode *> &SplitOrderedHashTable::bucket_slot(size_t bucket)
+{
+    int s = bucket == 0 ? 0 : 64 - __builtin_clzll(bucket);
+    size_t first = s == 0 ? 0 : size_t(1) << (s - 1);
+    std::atomic<MarkedNode *> *seg = segments[s].load(std::memory_order_acquire);
+    if (seg == nullptr)
+    {
+        size_t len = s == 0 ? 1 : size_t(1) << (s - 1);
+        std::atomic<MarkedNode *> *fresh = new std::atomic<MarkedNode *>[len]();
+        if (segments[s].compare_exchange_strong(seg, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+            seg = fresh;
+        else
+            delete[] fresh; // seg is the winner's
+    }
+    return seg[bucket - first];
+}
+
+MarkedNode *SplitOrderedHashTable::get_bucket(size_t bucket)
+{
+    std::atomic<MarkedNode *> &slot = bucket_slot(bucket);
+    MarkedNode *sentinel = slot.load(std::memory_order_acquire);
+    if (sentinel != nullptr)
+        return sentinel;
+
+    // The parent bucket, without the top bit, is the one this bucket split from.
+    // Its sentinel comes before ours in the list, so the search starts there.
+    size_t parent = bucket & ~(size_t(1) << (63 - __builtin_clzll(bucket)));
+    MarkedNode *p = get_bucket(parent);
+    MarkedNode *node = new MarkedNode(sentinel_order(bucket), 0, 0);
+    sentinel = HarrisList::insert(&p->next, node);
+    if (sentinel != node)
+        delete node; // another thread linked it first, ours was never visible
+    slot.store(sentinel, std::memory_order_release);
+    return sentinel;
+}
+
+bool SplitOrderedHashTable::contains(unsigned int key)
+{
+    return get_value(key).first;
+}
+
+bool SplitOrderedHashTable::insert(unsigned int key, unsigned int val)
+{
+    EpochGuard guard;
+    uint32_t h = hash(key);
+    size_t buckets = bucket_count.load(std::memory_order_acquire);
+    MarkedNode *s = get_bucket(h & (buckets - 1));
+    uint64_t order = regular_order(h);
+    // duplicates are common, don't allocate for them
+    if (HarrisList::lookup(&s->next, order) != nullptr)
+        return false;
+
+    MarkedNode *node = new MarkedNode(order, key, val);
+    if (HarrisList::insert(&s->next, node) != node)
+    {
+        delete node;
+        return false;
+    }
+    if (size.fetch_add(1, std::memory_order_relaxed) + 1 > buckets * MAX_LOAD)
+    {
+        // a failed CAS means someone else doubled it
+        bucket_count.compare_exchange_strong(buckets, buckets * 2);
+    }
+    return true;
+}
+
+bool SplitOrderedHashTable::remove(unsigned int key)
+{
+    EpochGuard guard;
+    uint32_t h = hash(key);
+    MarkedNode *s = get_bucket(h & (bucket_count.load(std::memory_order_acquire) - 1));
+    if (!HarrisList::remove(&s->next, regular_order(h)))
+        return false;
+    size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+std::pair<bool, unsigned int> SplitOrderedHashTable::get_value(unsigned int key)
+{
+    EpochGuard guard;
+    uint32_t h = hash(key);
+    MarkedNode *s = get_bucket(h & (bucket_count.load(std::memory_order_acquire) - 1));
+    MarkedNode *n = HarrisList::lookup(&s->next, regular_order(h));
+    if (n == nullptr)
+        return {false, 0}; // return 0 for failed search.
+    return {true, n->value.load(std::memory_order_relaxed)};
+}
+
+#endif
@@ -0,0 +1,55 @@
+// split_ordered_hash_table.h
+#ifndef SPLIT_ORDERED_HASH_TABLE_H
+#define SPLIT_ORDERED_HASH_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+#include "hash_policy.h"
+#include "harris_list.h"
+
+// Lock-free extensible hashing (Shalev and Shavit, split-ordered lists). Every entry
+// is in one sorted lock-free list, ordered by the bit reversed hash. A bucket is a
+// pointer to a sentinel node in that list, so doubling the bucket count only means
+// that new sentinels get linked in, lazily, the first time their bucket is used.
+// Entries never move and no operation ever waits for another. Removed nodes are
+// freed through the epoch reclaimer (epoch.h).
+class SplitOrderedHashTable
+{
+private:
+    // Average entries per bucket before the bucket count doubles.
+    static constexpr size_t MAX_LOAD = 2;
+    // Segment s holds buckets [2^(s-1), 2^s), segment 0 holds bucket 0.
+    static constexpr int MAX_SEGMENTS = 33;
+
+    std::atomic<std::atomic<MarkedNode *> *> segments[MAX_SEGMENTS];
+    std::atomic<size_t> bucket_count; // a power of 2, only grows
+    std::atomic<size_t> size;
+
+    // murmur3's finalizer is a bijection on 32 bits, so distinct keys get distinct orders
+    static uint32_t hash(uint32_t key) { return MurmurHash{}(key); }
+    static uint32_t reverse_bits(uint32_t x);
+    // A bucket's sentinel sorts right before the entries of the bucket: regular
+    // orders have the low bit set, sentinel orders don't.
+    static uint64_t regular_order(uint32_t h) { return (static_cast<uint64_t>(reverse_bits(h)) << 1) | 1; }
+    static uint64_t sentinel_order(size_t bucket) { return static_cast<uint64_t>(reverse_bits(bucket)) << 1; }
+
+    std::atomic<MarkedNode *> &bucket_slot(size_t bucket);
+    // sentinel of bucket, linked into the list first if needed
+    MarkedNode *get_bucket(size_t bucket);
+
+public:
+    SplitOrderedHashTable(size_t cap);
+    ~SplitOrderedHashTable();
+
+    bool contains(unsigned int key);
+
+    bool insert(unsigned int key, unsigned int val);
+
+    bool remove(unsigned int key);
+
+    std::pair<bool, unsigned int> get_value(unsigned int key);
+};
+
+#endif
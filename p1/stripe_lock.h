@@ -0,0 +1,78 @@
+// stripe_lock.h
+#ifndef STRIPE_LOCK_H
+#define STRIPE_LOCK_H
+
+#include <stdint.h>
+#include <atomic>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Spins for a while, then parks on the lock word (futex style).
+// state: 0 unlocked, 1 locked, 2 locked and somebody is parked.
+class StripeLock
+{
+private:
+    static constexpr int SPINS = 128;
+    std::atomic<uint32_t> state;
+
+public:
+    StripeLock() : state(0) {}
+
+    void lock()
+    {
+        uint32_t expected = 0;
+        for (int i = 0; i < SPINS; ++i)
+        {
+            if (state.load(std::memory_order_relaxed) == 0 &&
+                state.compare_exchange_weak(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            expected = 0;
+#ifdef __SSE2__
+            _mm_pause();
+#endif
+        }
+        while (state.exchange(2, std::memory_order_acquire) != 0)
+        {
+            state.wait(2, std::memory_order_relaxed);
+        }
+    }
+
+    void unlock()
+    {
+        if (state.exchange(0, std::memory_order_release) == 2)
+        {
+            state.notify_one();
+        }
+    }
+};
+
+// One lock stripe and the version its lookups validate against, on its own cache line
+// so that neighbouring stripes don't false-share.
+struct alignas(64) Stripe
+{
+    StripeLock lock;
+    std::atomic<uint64_t> seq;
+
+    Stripe() : seq(0) {}
+};
+
+// Seqlock write side: the stripe version is odd while its buckets are being changed.
+// Must be taken with the stripe lock held, and never nested on the same stripe.
+struct SeqWriter
+{
+    std::atomic<uint64_t> &seq;
+
+    SeqWriter(std::atomic<uint64_t> &s) : seq(s)
+    {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    ~SeqWriter()
+    {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef USE_TBB
+#include "swiss_hash_table.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t cap = 1;
+    while (cap < n)
+        cap <<= 1;
+    return cap;
+}
+
+SwissGroups::SwissGroups(size_t n)
+    : count(n), mask(n - 1), shift(64 - __builtin_ctzll(n)), ctrl(new SwissCtrl[n]), slots(new SwissSlots[n])
+{
+}
+
+SwissHashTable::SwissHashTable(size_t cap) : size(0), used(0), reserved(0), stripes(NUM_STRIPES)
+{
+    size_t groups = round_up_pow2(std::max<size_t>(cap * MAX_LOAD_DEN / MAX_LOAD_NUM / SwissSlots::SLOTS + 1, 2));
+    capacity.store(groups * SwissSlots::SLOTS);
+    current.store(new SwissGroups(groups), std::memory_order_release);
+}
+
+SwissHashTable::~SwissHashTable()
+{
+    delete current.load();
+    for (SwissGroups *t : retired)
+    {
+        delete t;
+    }
+}
+
+bool SwissHashTable::find(const SwissGroups *t, uint32_t key, uint64_t h, size_t &g, int &i, uint64_t &word)
+{
+    uint8_t fp = fingerprint(h);
+    g = t->home(h);
+    for (size_t step = 1; step <= t->count; ++step)
+    {
+        const SwissCtrl &c = t->ctrl[g];
+        uint64_t lo = c.lo.load(std::memory_order_acquire);
+        uint64_t hi = c.hi.load(std::memory_order_acquire);
+        for (unsigned int m = SwissCtrl::match(lo, hi, fp); m != 0; m &= m - 1)
+        {
+            i = __builtin_ctz(m);
+            word = t->slots[g].slots[i].load(std::memory_order_acquire);
+            if ((word >> 32) == key)
+                return true;
+        }
+        if (SwissCtrl::match(lo, hi, SW_CTRL_EMPTY) != 0)
+            return false;
+        g = t->next(g, step);
+    }
+    return false;
+}
+
+bool SwissHashTable::claim(SwissGroups *t, uint64_t h, uint64_t kv)
+{
+    uint8_t fp = fingerprint(h);
+    size_t g = t->home(h);
+    for (size_t step = 1; step <= t->count; ++step)
+    {
+        SwissCtrl &c = t->ctrl[g];
+        while (true)
+        {
+            uint64_t lo = c.lo.load(std::memory_order_relaxed);
+            uint64_t hi = c.hi.load(std::memory_order_relaxed);
+            unsigned int m = SwissCtrl::match_free(lo, hi);
+            if (m == 0)
+                break;
+            int i = __builtin_ctz(m);
+            uint64_t w = i < 8 ? lo : hi;
+            int shift = (i & 7) * 8;
+            uint8_t old = static_cast<uint8_t>(w >> shift);
+            // the byte is ours once the CAS succeeds, readers skip it until the slot holds our key
+            if (c.word(i).compare_exchange_weak(w, (w & ~(0xFFULL << shift)) | (static_cast<uint64_t>(fp) << shift)))
+            {
+                t->slots[g].slots[i].store(kv, std::memory_order_release);
+                if (old == SW_CTRL_EMPTY)
+                    used++;
+                return true;
+            }
+        }
+        g = t->next(g, step);
+    }
+    return false;
+}
+
+void SwissHashTable::resize()
+{
+    if (!gate.close())
+    {
+        // Someone is already resizing it
+        return;
+    }
+    if (!needs_resize())
+    {
+        gate.open();
+        return;
+    }
+
+    // No writer is inside, the table holds still while it is copied.
+    SwissGroups *t = current.load(std::memory_order_relaxed);
+    size_t live = 0;
+    for (size_t g = 0; g < t->count; ++g)
+    {
+        live += __builtin_popcount(~SwissCtrl::match_free(t->ctrl[g].lo.load(std::memory_order_relaxed),
+                                                          t->ctrl[g].hi.load(std::memory_order_relaxed)) &
+                                   0xFFFF);
+    }
+    size_t groups = t->count;
+    if (live * 2 >= groups * SwissSlots::SLOTS)
+        groups *= 2;
+
+    SwissGroups *nt = new SwissGroups(groups);
+    for (size_t g = 0; g < t->count; ++g)
+    {
+        uint64_t lo = t->ctrl[g].lo.load(std::memory_order_relaxed);
+        uint64_t hi = t->ctrl[g].hi.load(std::memory_order_relaxed);
+        for (unsigned int m = ~SwissCtrl::match_free(lo, hi) & 0xFFFF; m != 0; m &= m - 1)
+        {
+            uint64_t w = t->slots[g].slots[__builtin_ctz(m)].load(std::memory_order_relaxed);
+            claim(nt, hash(static_cast<uint32_t>(w >> 32)), w);
+        }
+    }
+    used.store(live);
+    capacity.store(groups * SwissSlots::SLOTS);
+    current.store(nt, std::memory_order_release);
+    retired.push_back(t);
+    gate.open();
+}
+
+bool SwissHashTable::contains(unsigned int key)
+{
+    return get_value(key).first;
+}
+
+bool SwissHashTable::insert(unsigned int key, unsigned int val)
+{
+    if (key == SW_EMPTY_KEY)
+    {
+        uint64_t expected = 0;
+        bool success = reserved.compare_exchange_strong(expected, (1ULL << 32) | val);
+        if (success)
+            size++;
+        return success;
+    }
+
+    uint64_t h = hash(key);
+    uint64_t kv = packKeyValue(key, val);
+    while (true)
+    {
+        std::atomic<size_t> *inside = gate.enter();
+        if (inside == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        bool found, claimed = false;
+        {
+            std::lock_guard<StripeLock> lock(stripes[stripe_index(h)].lock);
+            // the gate keeps resize() out, so the table can't change under us
+            SwissGroups *t = current.load(std::memory_order_acquire);
+            size_t g;
+            int i;
+            uint64_t word;
+            found = find(t, key, h, g, i, word);
+            if (!found)
+                claimed = claim(t, h, kv);
+        }
+        gate.leave(inside);
+
+        if (found)
+            return false;
+        if (claimed)
+        {
+            size++;
+            if (needs_resize())
+                resize();
+            return true;
+        }
+        // no free slot on the whole probe sequence
+        resize();
+    }
+}
+
+bool SwissHashTable::remove(unsigned int key)
+{
+    if (key == SW_EMPTY_KEY)
+    {
+        bool success = (reserved.exchange(0) != 0);
+        if (success)
+            size--;
+        return success;
+    }
+
+    uint64_t h = hash(key);
+    std::atomic<size_t> *inside;
+    while ((inside = gate.enter()) == nullptr)
+    {
+        std::this_thread::yield();
+    }
+    bool found;
+    {
+        std::lock_guard<StripeLock> lock(stripes[stripe_index(h)].lock);
+        SwissGroups *t = current.load(std::memory_order_acquire);
+        size_t g;
+        int i;
+        uint64_t word;
+        found = find(t, key, h, g, i, word);
+        if (found)
+        {
+            // clear the slot before its byte says it is free
+            t->slots[g].slots[i].store(SW_EMPTY, std::memory_order_relaxed);
+            std::atomic<uint64_t> &ctrl = t->ctrl[g].word(i);
+            int shift = (i & 7) * 8;
+            uint64_t w = ctrl.load(std::memory_order_relaxed);
+            uint8_t mark;
+            do
+            {
+                // While its word still has a free byte the group never sent a probe
+                // on to the next one, so the slot can be free again instead of deleted.
+                mark = (SwissCtrl::match(w, w, SW_CTRL_EMPTY) & 0xFF) ? SW_CTRL_EMPTY : SW_CTRL_DELETED;
+            } while (!ctrl.compare_exchange_weak(w, (w & ~(0xFFULL << shift)) | (static_cast<uint64_t>(mark) << shift)));
+            if (mark == SW_CTRL_EMPTY)
+                used--;
+        }
+    }
+    gate.leave(inside);
+    if (found)
+        size--;
+    return found;
+}
+
+std::pair<bool, unsigned int> SwissHashTable::get_value(unsigned int key)
+{
+    if (key == SW_EMPTY_KEY)
+    {
+        uint64_t r = reserved.load(std::memory_order_acquire);
+        return {r != 0, static_cast<uint32_t>(r)};
+    }
+
+    const SwissGroups *t = current.load(std::memory_order_acquire);
+    size_t g;
+    int i;
+    uint64_t word;
+    if (!find(t, key, hash(key), g, i, word))
+        return {false, 0}; // return 0 for failed search.
+    return {true, static_cast<uint32_t>(word)};
+}
+
+void SwissHashTable::get_value_batch(const uint32_t *keys, size_t n, uint32_t *values, bool *found)
+{
+    uint64_t hashes[PREFETCH_GROUP];
+    for (size_t base = 0; base < n; base += PREFETCH_GROUP)
+    {
+        size_t m = std::min(PREFETCH_GROUP, n - base);
+        const SwissGroups *t = current.load(std::memory_order_acquire);
+        // 1. control bytes of every home group
+        for (size_t k = 0; k < m; ++k)
+        {
+            hashes[k] = hash(keys[base + k]);
+            __builtin_prefetch(&t->ctrl[t->home(hashes[k])]);
+        }
+        // 2. the slot of the first fingerprint match, the control bytes have arrived by now
+        for (size_t k = 0; k < m; ++k)
+        {
+            size_t g = t->home(hashes[k]);
+            unsigned int match = SwissCtrl::match(t->ctrl[g].lo.load(std::memory_order_relaxed),
+                                                  t->ctrl[g].hi.load(std::memory_order_relaxed), fingerprint(hashes[k]));
+            if (match != 0)
+                __builtin_prefetch(&t->slots[g].slots[__builtin_ctz(match)]);
+        }
+        // 3. the lookups themselves, mostly against cached lines
+        for (size_t k = 0; k < m; ++k)
+        {
+            std::pair<bool, unsigned int> res;
+            size_t g;
+            int i;
+            uint64_t word;
+            if (keys[base + k] == SW_EMPTY_KEY)
+                res = get_value(keys[base + k]);
+            else if (find(t, keys[base + k], hashes[k], g, i, word))
+                res = {true, static_cast<uint32_t>(word)};
+            else
+                res = {false, 0};
+            values[base + k] = res.second;
+            if (found != nullptr)
+                found[base + k] = res.first;
+        }
+    }
+}
+
+#endif
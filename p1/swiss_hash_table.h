@@ -0,0 +1,168 @@
+// swiss_hash_table.h
+#ifndef SWISS_HASH_TABLE_H
+#define SWISS_HASH_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+#include "key_value.h"
+#include "stripe_lock.h"
+#include "resize_gate.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open addressing in groups of 16 slots, after Abseil's SwissTable. Next to the slots
+// is a separate array of control bytes, one per slot: free, deleted, or 7 bits of the
+// key's hash. A probe compares a whole group of control bytes at once and only reads
+// the slots whose byte matches, so a lookup costs about one control line and one slot line.
+static constexpr uint32_t SW_EMPTY_KEY = 0xFFFFFFFF;
+static const uint64_t SW_EMPTY = packKeyValue(SW_EMPTY_KEY, 0);
+static constexpr uint8_t SW_CTRL_EMPTY = 0x80;
+static constexpr uint8_t SW_CTRL_DELETED = 0xFE;
+
+// Control bytes of one group as two words, so they can be read atomically and
+// claimed one byte at a time with a CAS.
+struct alignas(16) SwissCtrl
+{
+    std::atomic<uint64_t> lo; // slots 0-7
+    std::atomic<uint64_t> hi; // slots 8-15
+
+    SwissCtrl() : lo(0x8080808080808080ULL), hi(0x8080808080808080ULL) {}
+
+    std::atomic<uint64_t> &word(int i) { return i < 8 ? lo : hi; }
+
+    // bit i is set if control byte i equals b
+    static unsigned int match(uint64_t lo, uint64_t hi, uint8_t b)
+    {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_set_epi64x(static_cast<long long>(hi), static_cast<long long>(lo));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(b))));
+#else
+        unsigned int m = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            m |= (static_cast<uint8_t>(lo >> (8 * i)) == b) << i;
+            m |= (static_cast<uint8_t>(hi >> (8 * i)) == b) << (i + 8);
+        }
+        return m;
+#endif
+    }
+
+    // bit i is set if slot i is free or deleted, the only bytes with the top bit set
+    static unsigned int match_free(uint64_t lo, uint64_t hi)
+    {
+#ifdef __SSE2__
+        return _mm_movemask_epi8(_mm_set_epi64x(static_cast<long long>(hi), static_cast<long long>(lo)));
+#else
+        unsigned int m = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            m |= ((lo >> (8 * i + 7)) & 1) << i;
+            m |= ((hi >> (8 * i + 7)) & 1) << (i + 8);
+        }
+        return m;
+#endif
+    }
+};
+
+struct alignas(64) SwissSlots
+{
+    static constexpr int SLOTS = 16;
+    std::atomic<uint64_t> slots[SLOTS];
+
+    SwissSlots()
+    {
+        for (int i = 0; i < SLOTS; ++i)
+            slots[i].store(SW_EMPTY, std::memory_order_relaxed);
+    }
+};
+
+struct SwissGroups
+{
+    size_t count; // groups, a power of 2 no smaller than 2
+    size_t mask;
+    int shift; // home group is the top log2(count) bits of the hash
+    SwissCtrl *ctrl;
+    SwissSlots *slots;
+
+    SwissGroups(size_t n);
+    ~SwissGroups()
+    {
+        delete[] ctrl;
+        delete[] slots;
+    }
+
+    size_t home(uint64_t h) const { return h >> shift; }
+    // Triangular steps over groups visit every group once when count is a power of 2.
+    size_t next(size_t g, size_t step) const { return (g + step) & mask; }
+};
+
+// Writers of a key serialize on its stripe and claim control bytes with a CAS, so
+// writers of different keys only meet on a shared control word. Lookups take no
+// lock at all: a slot's key and value are one word, and a group that has lost its
+// last free byte never gets one back, so a probe can stop at the first group with a
+// free byte. Deleted slots are reused by inserts and cleared by resize(), which
+// closes the gate to writers while it rebuilds the table.
+class SwissHashTable
+{
+private:
+    static constexpr size_t NUM_STRIPES = 1024;
+    // Grow or rebuild once full and deleted slots pass 7/8 of the table.
+    static constexpr size_t MAX_LOAD_NUM = 7;
+    static constexpr size_t MAX_LOAD_DEN = 8;
+    // Keys whose groups get_value_batch prefetches before probing any of them.
+    static constexpr size_t PREFETCH_GROUP = 16;
+
+    std::atomic<SwissGroups *> current;
+    std::atomic<size_t> size;
+    std::atomic<size_t> used;     // full and deleted slots of current
+    std::atomic<size_t> capacity; // slots of current
+    std::atomic<uint64_t> reserved; // entry for SW_EMPTY_KEY: 0 if absent, (1 << 32 | val) otherwise
+    ResizeGate gate; // writers stay out while resize() rebuilds the table
+    std::vector<Stripe> stripes;
+    // Readers may still be probing an old table, so they are only freed in the destructor.
+    std::vector<SwissGroups *> retired;
+
+    // 64 well mixed bits: the top ones pick the group, the low 7 are the control byte.
+    static uint64_t hash(uint32_t key)
+    {
+        uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 32);
+    }
+    static uint8_t fingerprint(uint64_t h) { return h & 0x7F; }
+    static size_t stripe_index(uint64_t h) { return (h >> 32) & (NUM_STRIPES - 1); }
+
+    // Looks key up along its probe sequence. On success g and i locate its slot, and
+    // word is what the slot held when it matched.
+    static bool find(const SwissGroups *t, uint32_t key, uint64_t h, size_t &g, int &i, uint64_t &word);
+    // Puts kv in the first free or deleted slot of its probe sequence. False if the table is full.
+    bool claim(SwissGroups *t, uint64_t h, uint64_t kv);
+    // Rebuilds the table without deleted slots, twice as large if it is more than half full.
+    void resize();
+    bool needs_resize() const
+    {
+        return used.load() * MAX_LOAD_DEN >= capacity.load() * MAX_LOAD_NUM;
+    }
+
+public:
+    SwissHashTable(size_t cap);
+    ~SwissHashTable();
+
+    bool contains(unsigned int key);
+
+    bool insert(unsigned int key, unsigned int val);
+
+    bool remove(unsigned int key);
+
+    std::pair<bool, unsigned int> get_value(unsigned int key);
+
+    // Lookups of n keys, with the control bytes and the matching slots of a group of
+    // keys prefetched before any of them is probed. found may be nullptr.
+    void get_value_batch(const uint32_t *keys, size_t n, uint32_t *values, bool *found = nullptr);
+};
+
+#endif
@@ -0,0 +1,377 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../epoch.h"
+#include "hash_table.h"
+#include "lock_free_hash_table.h"
+#include "oa_hash_table.h"
+#include "snapshot.h"
+
+using std::cout;
+using std::endl;
+
+static constexpr uint64_t RANDOM_SEED = 42;
+
+unsigned int NUM_THREADS = std::max(4u, std::thread::hardware_concurrency());
+
+// Node of the reclamation test. The test deleter only marks it dead and keeps it,
+// so a reader that still holds it after it was freed sees DEAD.
+struct EpochNode
+{
+    static constexpr uint64_t LIVE = 0x1151151151151151ULL;
+    static constexpr uint64_t DEAD = 0xDEADDEADDEADDEADULL;
+    std::atomic<uint64_t> magic{LIVE};
+    uint64_t value;
+};
+
+static std::atomic<uint64_t> nodes_freed{0};
+static std::mutex graveyard_mtx;
+static std::vector<EpochNode *> graveyard;
+
+static void bury_node(void *p)
+{
+    EpochNode *n = static_cast<EpochNode *>(p);
+    n->magic.store(EpochNode::DEAD, std::memory_order_relaxed);
+    nodes_freed++;
+    std::lock_guard<std::mutex> lock(graveyard_mtx);
+    graveyard.push_back(n);
+}
+
+static std::atomic<uint64_t> large_freed{0};
+
+static void free_large(void *p)
+{
+    delete[] static_cast<char *>(p);
+    large_freed++;
+}
+
+// Test case 1: writers replace and retire nodes while readers stay pinned on them
+void test_epoch_reclamation()
+{
+    cout << "\n=== Running Epoch Reclamation Test ===\n";
+    constexpr size_t SLOTS = 16;
+    constexpr uint64_t RETIRES_PER_WRITER = 200000;
+    std::atomic<EpochNode *> slots[SLOTS];
+    for (size_t i = 0; i < SLOTS; ++i)
+    {
+        slots[i].store(new EpochNode{EpochNode::LIVE, i});
+    }
+
+    unsigned int writers = NUM_THREADS / 2, readers = NUM_THREADS - writers;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> dead_reads{0}, reads{0};
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < writers; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            std::mt19937 gen(RANDOM_SEED + t);
+            for (uint64_t i = 0; i < RETIRES_PER_WRITER; ++i)
+            {
+                EpochNode *fresh = new EpochNode{EpochNode::LIVE, i};
+                EpochNode *old = slots[gen() % SLOTS].exchange(fresh, std::memory_order_acq_rel);
+                Epoch::retire(old, bury_node);
+                if (i % 256 == 0)
+                    std::this_thread::yield(); // let the readers in, on few cores too
+            } });
+    }
+    for (unsigned int t = 0; t < readers; ++t)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            std::mt19937 gen(RANDOM_SEED + 100 + t);
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                EpochGuard guard;
+                EpochNode *n = slots[gen() % SLOTS].load(std::memory_order_acquire);
+                // hold the node for a while, long enough for writers to retire it
+                for (int k = 0; k < 64; ++k)
+                {
+                    if (n->magic.load(std::memory_order_relaxed) != EpochNode::LIVE)
+                        dead_reads++;
+                    if (k % 16 == 0)
+                        std::this_thread::yield();
+                }
+                reads++;
+            } });
+    }
+    for (unsigned int t = 0; t < writers; ++t)
+    {
+        threads[t].join();
+    }
+    stop = true;
+    for (unsigned int t = writers; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+
+    assert(dead_reads.load() == 0);
+    // every writer's limbo holds back a few batches at most
+    assert(nodes_freed.load() > 0);
+    cout << "Reads: " << reads.load() << " | Retired: " << writers * RETIRES_PER_WRITER
+         << " | Freed before the end: " << nodes_freed.load() << "\n";
+
+    for (size_t i = 0; i < SLOTS; ++i)
+    {
+        delete slots[i].load();
+    }
+    std::lock_guard<std::mutex> lock(graveyard_mtx);
+    for (EpochNode *n : graveyard)
+    {
+        delete n;
+    }
+    graveyard.clear();
+    cout << "No node was freed while a reader held it.\n";
+}
+
+// Test case 2: large objects are freed by synchronize(), even with a pinned reader around
+void test_epoch_synchronize()
+{
+    cout << "\n=== Running Epoch Synchronize Test ===\n";
+    constexpr size_t LARGE = 1 << 20;
+    std::atomic<bool> stop{false};
+    std::thread reader([&]()
+                       {
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            EpochGuard guard;
+            std::this_thread::yield();
+        } });
+
+    uint64_t before = large_freed.load();
+    std::thread retirer([&]()
+                        { Epoch::retire(new char[LARGE], free_large, LARGE); });
+    retirer.join();
+    // retired by a thread that is gone, freed by this one
+    Epoch::synchronize();
+    assert(large_freed.load() == before + 1);
+    stop = true;
+    reader.join();
+    cout << "Large object freed after synchronize.\n";
+}
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+// from sanitizer/allocator_interface.h, which not every toolchain ships
+extern "C" size_t __sanitizer_get_current_allocated_bytes();
+#endif
+
+// bytes handed out by malloc and not freed yet
+static size_t heap_in_use()
+{
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+    // the sanitizers replace malloc, mallinfo2() doesn't see their heap
+    return __sanitizer_get_current_allocated_bytes();
+#else
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+#endif
+}
+
+// Test case 3: insert/remove churn keeps rehashing OAHashTable, the old slot
+// arrays must be freed even with readers probing them
+void test_oa_churn_memory()
+{
+    cout << "\n=== Running OA Churn Memory Test ===\n";
+    constexpr size_t CAPACITY = 1 << 18;
+    constexpr uint32_t KEYS_PER_ROUND = 600000;
+    constexpr int ROUNDS = 8;
+    OAHashTable ht(CAPACITY);
+    size_t baseline = heap_in_use();
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> bad_reads{0};
+    std::vector<std::thread> readers;
+    for (unsigned int t = 0; t < NUM_THREADS - 1; ++t)
+    {
+        readers.emplace_back([&, t]()
+                             {
+            std::mt19937 gen(RANDOM_SEED + t);
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                // values are always key + 1, if present at all
+                uint32_t key = gen() % (KEYS_PER_ROUND * ROUNDS);
+                auto r = ht.get_value(key);
+                if (r.first && r.second != key + 1)
+                    bad_reads++;
+            } });
+    }
+
+    // fresh keys every time: each remove leaves a tombstone, so the table rehashes
+    // at the same capacity over and over
+    uint32_t key = 0;
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (uint32_t i = 0; i < KEYS_PER_ROUND; ++i, ++key)
+        {
+            ht.insert(key, key + 1);
+            ht.remove(key);
+        }
+    }
+    stop = true;
+    for (auto &r : readers)
+    {
+        r.join();
+    }
+    Epoch::synchronize();
+
+    size_t array_bytes = CAPACITY * 2 * sizeof(uint64_t);
+    size_t growth = heap_in_use() - std::min(heap_in_use(), baseline);
+    cout << "Heap growth after " << ROUNDS << " rounds: " << growth / 1024 << " KiB"
+         << " | Slot array: " << array_bytes / 1024 << " KiB\n";
+    assert(bad_reads.load() == 0);
+    // only the live slot array may be left, not one per rehash
+    assert(growth < array_bytes);
+    cout << "Old slot arrays were freed.\n";
+}
+
+// Test case 4: the generations a shrinking HashTable drains are freed by shrink_to_fit()
+void test_chained_shrink_memory()
+{
+    cout << "\n=== Running Chained Shrink Memory Test ===\n";
+    constexpr uint32_t KEYS = 2000000;
+    constexpr int CYCLES = 4;
+    HashTable ht(1000);
+    size_t first_shrunk = 0;
+    for (int cycle = 0; cycle < CYCLES; ++cycle)
+    {
+        // keeps the removes from shrinking it on the way down
+        ht.reserve(KEYS);
+        for (uint32_t k = 0; k < KEYS; ++k)
+        {
+            ht.insert(k, k + 1);
+        }
+        for (uint32_t k = 0; k < KEYS; ++k)
+        {
+            ht.remove(k);
+        }
+        size_t emptied = heap_in_use();
+        ht.shrink_to_fit();
+        size_t shrunk = heap_in_use();
+        cout << "Cycle " << cycle + 1 << " | Heap before shrink_to_fit: " << emptied / 1024
+             << " KiB | after: " << shrunk / 1024 << " KiB\n";
+        if (cycle == 0)
+            first_shrunk = shrunk;
+        // the big generation is gone, only the pooled overflow lines stay
+        assert(shrunk < emptied);
+        assert(shrunk <= first_shrunk + (1 << 20));
+    }
+    cout << "Drained generations were freed.\n";
+}
+
+static std::vector<char> read_file(const std::string &name)
+{
+    std::ifstream in(name, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string &name, const std::vector<char> &bytes)
+{
+    std::ofstream out(name, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+// Test case 5: snapshots with a header or offsets that don't fit the file are rejected
+void test_snapshot_validation()
+{
+    cout << "\n=== Running Snapshot Validation Test ===\n";
+    std::string good = (std::filesystem::temp_directory_path() / "test1_snapshot.bin").string();
+    std::string bad = (std::filesystem::temp_directory_path() / "test1_snapshot_bad.bin").string();
+    constexpr uint32_t KEYS = 5000;
+    {
+        HashTable ht(KEYS);
+        for (uint32_t k = 0; k < KEYS; ++k)
+        {
+            ht.insert(k, k + 1);
+        }
+        assert(ht.save(good.c_str()));
+    }
+    {
+        SnapshotView<FibonacciHash> view(good.c_str());
+        assert(view.valid() && view.size() == KEYS);
+        assert(view.get_value(KEYS / 2).second == KEYS / 2 + 1);
+    }
+
+    const std::vector<char> bytes = read_file(good);
+    SnapshotHeader h;
+    memcpy(&h, bytes.data(), sizeof(h));
+    auto corrupt = [&](const char *what, auto change)
+    {
+        std::vector<char> copy = bytes;
+        SnapshotHeader *ch = reinterpret_cast<SnapshotHeader *>(copy.data());
+        change(ch, reinterpret_cast<uint64_t *>(ch + 1));
+        write_file(bad, copy);
+        SnapshotView<FibonacciHash> view(bad.c_str());
+        assert(!view.valid());
+        HashTable *ht = HashTable::load(bad.c_str());
+        assert(ht == nullptr);
+        cout << "Rejected: " << what << "\n";
+    };
+    // Both keep the total length right once the products wrap around: (2^61 + 1) * 8
+    // is 8, and 2^61 more entries add nothing.
+    corrupt("huge capacity", [&](SnapshotHeader *ch, uint64_t *)
+            { ch->capacity = 1ULL << 61; ch->size = h.capacity + h.size; });
+    corrupt("huge size", [&](SnapshotHeader *ch, uint64_t *)
+            { ch->size = h.size + (1ULL << 61); });
+    corrupt("first offset not 0", [](SnapshotHeader *, uint64_t *offsets)
+            { offsets[0] = 1; });
+    corrupt("decreasing offset", [&](SnapshotHeader *, uint64_t *offsets)
+            { offsets[h.capacity / 2] = h.size + 1; });
+    corrupt("last offset not size", [&](SnapshotHeader *, uint64_t *offsets)
+            { offsets[h.capacity] = h.size - 1; });
+
+    std::filesystem::remove(good);
+    std::filesystem::remove(bad);
+    cout << "Corrupt snapshots were rejected.\n";
+}
+
+// Test case 6: a LockFreeHashTable destroyed while a resize is still moving buckets
+// frees the nodes of the old generation too
+void test_lock_free_destroy_mid_resize()
+{
+    cout << "\n=== Running Lock-Free Destroy Mid-Resize Test ===\n";
+    // the last insert of each count starts a resize that only a few buckets get through
+    const uint32_t counts[] = {2049, 4097, 8193};
+    for (int warmup = 0; warmup < 2; ++warmup)
+    {
+        for (uint32_t n : counts)
+        {
+            size_t before = heap_in_use();
+            LockFreeHashTable *ht = new LockFreeHashTable(16);
+            for (uint32_t k = 0; k < n; ++k)
+            {
+                ht->insert(k, k + 1);
+            }
+            delete ht;
+            // the generations drained before are retired, not freed yet
+            Epoch::synchronize();
+            size_t after = heap_in_use();
+            if (warmup == 0)
+                continue; // the epoch lists have grown to size now
+            cout << "Keys: " << n << " | Heap left behind: " << (after > before ? after - before : 0) << " bytes\n";
+            assert(after <= before + 1024);
+        }
+    }
+    cout << "No node was left behind.\n";
+}
+
+int main()
+{
+    test_epoch_reclamation();
+    test_epoch_synchronize();
+    test_oa_churn_memory();
+    test_chained_shrink_memory();
+    test_snapshot_validation();
+    test_lock_free_destroy_mid_resize();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "boundedqueue.h"
+#include <stdint.h>
+
+BoundedQueue::BoundedQueue(size_t cap)
+{
+    size_t n = 2;
+    while (n < cap)
+        n <<= 1;
+    mask = n - 1;
+    slots = new Slot[n];
+    for (size_t i = 0; i < n; ++i)
+    {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    tail.store(0, std::memory_order_relaxed);
+    head.store(0, std::memory_order_relaxed);
+}
+
+BoundedQueue::~BoundedQueue()
+{
+    delete[] slots;
+}
+
+bool BoundedQueue::enq(uint32_t x)
+{
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+        slot = &slots[pos & mask];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            // the slot is free for pos, claim it
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // still holds the element of pos - capacity
+            return false;
+        }
+        else
+        {
+            // another producer took pos
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    slot->val = x;
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+int BoundedQueue::deq()
+{
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+        slot = &slots[pos & mask];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0)
+        {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // nothing was put at pos yet
+            return -1;
+        }
+        else
+        {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    int val = slot->val;
+    // free for the producer one lap later
+    slot->seq.store(pos + mask + 1, std::memory_order_release);
+    return val;
+}
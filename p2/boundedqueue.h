@@ -0,0 +1,46 @@
+// boundedqueue.h
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Bounded MPMC queue over a ring of slots (Vyukov). Every slot carries a sequence
+// number that says whose turn it is: a producer at position pos may fill the slot
+// when its sequence is pos, a consumer may empty it when it is pos + 1. A claim is
+// one CAS on head or tail, and the data lives in the ring itself, so there is no
+// allocation and no pointer chasing per element.
+class BoundedQueue
+{
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        uint32_t val;
+    };
+
+    Slot *slots;
+    size_t mask; // capacity - 1, capacity is a power of 2
+
+    // producers and consumers each get their own cache line
+    alignas(64) std::atomic<size_t> tail; // next position to fill
+    alignas(64) std::atomic<size_t> head; // next position to empty
+
+public:
+    // Capacity is cap rounded up to a power of 2, at least 2.
+    BoundedQueue(size_t cap);
+    ~BoundedQueue();
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    // false if the queue is full
+    bool enq(uint32_t x);
+    // -1 if the queue is empty
+    int deq();
+
+    size_t capacity() const { return mask + 1; }
+};
+
+#endif
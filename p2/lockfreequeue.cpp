@@ -1,10 +1,53 @@
 #include "lockfreequeue.h"
 #include "mypointerintpair.h"
+#include "../epoch.h"
+#include "../slab_pool.h"
 #include <iostream>
 
+// Shared by every queue: a retired node can still be in a limbo list after its queue is gone.
+static SlabPool<Node> node_pool;
+
+static Node *new_node(uint32_t x)
+{
+    Node *n = node_pool.alloc();
+    n->val = x;
+    n->next.store(nullptr, std::memory_order_relaxed);
+    return n;
+}
+
+static void free_node(void *n)
+{
+    node_pool.release(static_cast<Node *>(n));
+}
+
+LockFreeQueue::LockFreeQueue()
+{
+    PIP initial(new_node(0), 0);
+    head.store(initial, std::memory_order_relaxed);
+    tail.store(initial, std::memory_order_relaxed);
+}
+
+LockFreeQueue::~LockFreeQueue()
+{
+    Node *current = head.load().getPtr();
+    while (current != nullptr)
+    {
+        Node *next = current->next.load();
+        free_node(current);
+        current = next;
+    }
+}
+
+size_t LockFreeQueue::node_allocations()
+{
+    return node_pool.slab_count();
+}
+
 bool LockFreeQueue::enq(uint32_t x)
 {
-    Node *curr = new Node(x);
+    Node *curr = new_node(x);
+    // last may be dequeued and retired while we look at it
+    EpochGuard guard;
     while (true)
     {
         PIP tail_pip = tail.load(std::memory_order_acquire);
@@ -33,6 +76,7 @@ bool LockFreeQueue::enq(uint32_t x)
 
 int LockFreeQueue::deq()
 {
+    EpochGuard guard;
     while (true)
     {
         PIP head_pip = head.load(std::memory_order_acquire);
@@ -55,7 +99,8 @@ int LockFreeQueue::deq()
                 PIP new_head(next, head_pip.getCnt() + 1);
                 if (head.compare_exchange_strong(head_pip, new_head, std::memory_order_release, std::memory_order_relaxed))
                 {
-                    delete first;
+                    // a slower thread may still be reading first->next
+                    Epoch::retire(first, free_node);
                     return val;
                 }
             }
@@ -63,6 +108,96 @@ int LockFreeQueue::deq()
     }
 }
 
+bool LockFreeQueue::enq_bulk(const uint32_t *vals, size_t n)
+{
+    if (n == 0)
+        return true;
+    // The chain is private until the release CAS below publishes it.
+    Node *chain_first = new_node(vals[0]);
+    Node *chain_last = chain_first;
+    for (size_t i = 1; i < n; ++i)
+    {
+        Node *curr = new_node(vals[i]);
+        chain_last->next.store(curr, std::memory_order_relaxed);
+        chain_last = curr;
+    }
+    EpochGuard guard;
+    while (true)
+    {
+        PIP tail_pip = tail.load(std::memory_order_acquire);
+        Node *last = tail_pip.getPtr();
+        Node *next = last->next.load(std::memory_order_acquire);
+
+        if (tail_pip == tail.load(std::memory_order_acquire)) // double check
+        {
+            if (next == nullptr)
+            {
+                if (last->next.compare_exchange_strong(next, chain_first, std::memory_order_release, std::memory_order_relaxed))
+                {
+                    // if this fails, others move tail along the chain one node at a time
+                    PIP new_tail_pip(chain_last, tail_pip.getCnt() + 1);
+                    tail.compare_exchange_strong(tail_pip, new_tail_pip, std::memory_order_release, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            else
+            {
+                PIP new_tail_pip(next, tail_pip.getCnt() + 1);
+                tail.compare_exchange_strong(tail_pip, new_tail_pip, std::memory_order_release, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+size_t LockFreeQueue::deq_bulk(uint32_t *out, size_t max)
+{
+    if (max == 0)
+        return 0;
+    EpochGuard guard;
+    while (true)
+    {
+        PIP head_pip = head.load(std::memory_order_acquire);
+        Node *first = head_pip.getPtr();
+        PIP tail_pip = tail.load(std::memory_order_acquire);
+        Node *last = tail_pip.getPtr();
+        Node *next = first->next.load(std::memory_order_acquire);
+        if (head_pip != head.load(std::memory_order_acquire))
+            continue;
+        if (first == last)
+        {
+            if (next == nullptr)
+                return 0;
+            PIP new_tail_pip(next, tail_pip.getCnt() + 1);
+            tail.compare_exchange_strong(tail_pip, new_tail_pip, std::memory_order_release, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Read ahead from next, but not past last: head must not overtake tail.
+        // The values only count if head is still head_pip below.
+        size_t taken = 0;
+        Node *new_head = first;
+        for (Node *n = next; n != nullptr && taken < max; n = n->next.load(std::memory_order_acquire))
+        {
+            out[taken++] = n->val;
+            new_head = n;
+            if (n == last)
+                break;
+        }
+        PIP new_head_pip(new_head, head_pip.getCnt() + 1);
+        if (head.compare_exchange_strong(head_pip, new_head_pip, std::memory_order_release, std::memory_order_relaxed))
+        {
+            // every node before the new head is ours now, their next links no longer change
+            for (Node *n = first; n != new_head;)
+            {
+                Node *following = n->next.load(std::memory_order_relaxed);
+                Epoch::retire(n, free_node);
+                n = following;
+            }
+            return taken;
+        }
+    }
+}
+
 void LockFreeQueue::print()
 {
     PIP head_pip = head.load();
@@ -1,4 +1,5 @@
 // lockfreequeue.h
+#include <stddef.h>
 #include <atomic>
 #include "mypointerintpair.h"
 
@@ -6,7 +7,7 @@ struct Node
 {
     uint32_t val;
     std::atomic<Node *> next;
-    Node(uint32_t x, Node *nxt = nullptr) : val(x), next(nxt) {}
+    Node(uint32_t x = 0, Node *nxt = nullptr) : val(x), next(nxt) {}
 };
 
 using PIP = MyPointerIntPair<Node *>;
@@ -16,27 +17,20 @@ public:
     std::atomic<PIP> head;
     std::atomic<PIP> tail;
 
-    LockFreeQueue()
-    {
-        Node *n = new Node(0);
-        PIP initial(n, 0);
-        head.store(initial, std::memory_order_relaxed);
-        tail.store(initial, std::memory_order_relaxed);
-    }
-
-    ~LockFreeQueue()
-    {
-        // Basic cleanup. Not thread-safe. Assumes queue is quiescent.
-        Node *current = head.load().getPtr();
-        while (current != nullptr)
-        {
-            Node *next = current->next.load();
-            delete current;
-            current = next;
-        }
-    }
+    LockFreeQueue();
+    // Not thread-safe. Assumes queue is quiescent.
+    ~LockFreeQueue();
 
     bool enq(uint32_t x);
     int deq();
+    // Links vals[0..n) in order, with one CAS on the last node's next and one on tail.
+    bool enq_bulk(const uint32_t *vals, size_t n);
+    // Takes up to max values with one move of head. Returns how many, 0 if empty.
+    size_t deq_bulk(uint32_t *out, size_t max);
     void print();
+
+    // Heap allocations made for nodes so far, by all queues together. Nodes come
+    // from a shared slab pool and go back to it once reclaimed, so this stays flat
+    // once the queues have reached their working size.
+    static size_t node_allocations();
 };
\ No newline at end of file
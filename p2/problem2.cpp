@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cstdint>
@@ -9,13 +10,22 @@
 #include <string>
 #include <thread>
 #include <pthread.h>
+#include <utility>
 #include <vector>
 #include <atomic>
 
-#ifdef USE_BOOST_QUEUE
+#if defined(USE_BOOST_QUEUE)
 #include <boost/lockfree/queue.hpp>
+#elif defined(USE_BOUNDED_QUEUE)
+#include "boundedqueue.h"
+#elif defined(USE_SEGMENTED_QUEUE)
+#include "segmentedqueue.h"
 #else
 #include "lockfreequeue.h"
+// the linked queue reports the heap allocations made for its nodes
+#define COUNT_NODE_ALLOCATIONS
+// and can enqueue and dequeue in batches
+#define HAS_BULK_OPS
 #endif
 
 using std::cout;
@@ -86,6 +96,10 @@ uint64_t NUM_OPS = 1e6;
 uint64_t runs = 2;
 
 unsigned int NUM_THREADS = std::thread::hardware_concurrency(); // Default to hardware concurrency
+/** sweep the thread count up to the hardware threads instead of using NUM_THREADS */
+bool SCALING = false;
+/** values per enqueue or dequeue, more than 1 uses enq_bulk/deq_bulk */
+uint64_t BATCH_SIZE = 1;
 
 // List of valid flags and description
 void validFlagsDescription()
@@ -93,6 +107,8 @@ void validFlagsDescription()
     cout << "-ops=<value>: specify total number of operations (e.g., -ops=1000000)\n";
     cout << "-thr=<value>: number of threads to use (e.g., -thr=4)\n";
     cout << "-rns=<value>: the number of iterations (e.g., -rns=3)\n";
+    cout << "-scl=<value>: 1 to run with 1, 2, 4, ... threads up to all hardware threads (e.g., -scl=1)\n";
+    cout << "-bat=<value>: values per enqueue or dequeue, custom queue only (e.g., -bat=64)\n";
 }
 
 // Code snippet to parse command line flags and initialize the variables
@@ -133,6 +149,19 @@ int parse_args(char *arg)
     {
         runs = val;
     }
+    else if (s1 == "-scl")
+    {
+        SCALING = val != 0;
+    }
+    else if (s1 == "-bat")
+    {
+        if (val == 0)
+        {
+            cout << "Batch size must be positive.\n";
+            return 1;
+        }
+        BATCH_SIZE = val;
+    }
     else
     {
         std::cout << "Unsupported flag:" << s1 << "\n";
@@ -181,11 +210,19 @@ void worker_thread(ThreadArgs args)
     args.success_deq->fetch_add(local_success_deq);
 }
 
-#else // Using custom LockFreeQueue
+#else // Using custom LockFreeQueue, BoundedQueue or SegmentedQueue
+
+#if defined(USE_BOUNDED_QUEUE)
+using Queue = BoundedQueue;
+#elif defined(USE_SEGMENTED_QUEUE)
+using Queue = SegmentedQueue;
+#else
+using Queue = LockFreeQueue;
+#endif
 
 struct ThreadArgs
 {
-    LockFreeQueue *queue;
+    Queue *queue;
     const uint32_t *insert_data_start;
     uint64_t num_ops_per_thread;
     int thread_id;
@@ -202,8 +239,10 @@ void worker_thread(ThreadArgs args)
     {
         if (rand() % 8 == 0)
         {
-            args.queue->enq(args.insert_data_start[i % (args.num_ops_per_thread)]);
-            local_success_enq++;
+            if (args.queue->enq(args.insert_data_start[i % (args.num_ops_per_thread)])) // a BoundedQueue may be full
+            {
+                local_success_enq++;
+            }
         }
         else
         {
@@ -217,50 +256,61 @@ void worker_thread(ThreadArgs args)
     args.success_enq->fetch_add(local_success_enq);
     args.success_deq->fetch_add(local_success_deq);
 }
-#endif
 
-int main(int argc, char *argv[])
+#ifdef HAS_BULK_OPS
+// Same mix as worker_thread, but every enqueue or dequeue moves up to BATCH_SIZE values.
+void batch_worker_thread(ThreadArgs args)
 {
-    for (int i = 1; i < argc; i++)
+    uint64_t local_success_enq = 0;
+    uint64_t local_success_deq = 0;
+    std::vector<uint32_t> out(BATCH_SIZE);
+
+    for (uint64_t i = 0; i < args.num_ops_per_thread; i += BATCH_SIZE)
     {
-        int error = parse_args(argv[i]);
-        if (error == 1)
+        uint64_t n = std::min(BATCH_SIZE, args.num_ops_per_thread - i);
+        if (rand() % 8 == 0)
         {
-            cout << "Argument error, terminating run.\n";
-            exit(EXIT_FAILURE);
+            if (args.queue->enq_bulk(args.insert_data_start + i, n))
+            {
+                local_success_enq += n;
+            }
+        }
+        else
+        {
+            local_success_deq += args.queue->deq_bulk(out.data(), n);
         }
     }
-
-#ifdef USE_BOOST_QUEUE
-    cout << "Using Boost Lock-Free Queue" << endl;
-#else
-    cout << "Using Custom Lock-Free Queue" << endl;
+    args.success_enq->fetch_add(local_success_enq);
+    args.success_deq->fetch_add(local_success_deq);
+}
+#endif
 #endif
-    cout << "Total Ops: " << NUM_OPS << endl;
-    cout << "Threads: " << NUM_THREADS << endl;
-    cout << "Runs: " << runs << endl;
-
-    path cwd = std::filesystem::current_path();
-    path path_insert_values = cwd / "random_values_insert.bin";
-
-    assert(std::filesystem::exists(path_insert_values));
-
-    uint64_t max_possible_enqueues = NUM_OPS;
-    auto *values_insert = new uint32_t[max_possible_enqueues];
-    read_data(path_insert_values, max_possible_enqueues, values_insert);
 
+// Runs the benchmark `runs` times with NUM_THREADS threads, prints the averages and
+// returns the average throughput in K ops/sec.
+double run_benchmark(const uint32_t *values_insert)
+{
     float total_time = 0.0F;
     double total_ops_executed = 0;
     uint64_t total_success_enq_all_runs = 0;
     uint64_t total_success_deq_all_runs = 0;
+#ifdef COUNT_NODE_ALLOCATIONS
+    uint64_t total_allocations_all_runs = 0;
+#endif
 
     HRTimer start, end;
     for (uint32_t run = 0; run < runs; run++)
     {
 #ifdef USE_BOOST_QUEUE
         boost::lockfree::queue<uint32_t> queue_instance(NUM_OPS);
+#elif defined(USE_BOUNDED_QUEUE)
+        // same bound as the Boost queue
+        BoundedQueue queue_instance(NUM_OPS);
+#elif defined(USE_SEGMENTED_QUEUE)
+        SegmentedQueue queue_instance;
 #else
         LockFreeQueue queue_instance;
+        size_t allocations_before = LockFreeQueue::node_allocations();
 #endif
 
         std::vector<std::thread> threads(NUM_THREADS);
@@ -290,7 +340,12 @@ int main(int argc, char *argv[])
             thread_args[i].success_enq = &run_success_enq;
             thread_args[i].success_deq = &run_success_deq;
 
-            threads[i] = std::thread(worker_thread, thread_args[i]);
+            auto worker = worker_thread;
+#ifdef HAS_BULK_OPS
+            if (BATCH_SIZE > 1)
+                worker = batch_worker_thread;
+#endif
+            threads[i] = std::thread(worker, thread_args[i]);
 
             current_data_offset += data_needed;
         }
@@ -313,6 +368,12 @@ int main(int argc, char *argv[])
         total_ops_executed += successful_ops_this_run;
 
         cout << "Run " << (run + 1) << " completed in " << iter_time << " ms. ";
+#ifdef COUNT_NODE_ALLOCATIONS
+        // node slabs, the queue makes no other heap allocations
+        size_t run_allocations = LockFreeQueue::node_allocations() - allocations_before;
+        total_allocations_all_runs += run_allocations;
+        cout << "Heap allocations: " << run_allocations << ". ";
+#endif
     }
 
     float avg_time_ms = total_time / runs;
@@ -327,8 +388,83 @@ int main(int argc, char *argv[])
     cout << "Average successful ENQ ops per run: " << (double)total_success_enq_all_runs / runs << "\n";
     cout << "Average successful DEQ ops per run: " << (double)total_success_deq_all_runs / runs << "\n";
     cout << "Average total successful ops per run: " << avg_successful_ops << "\n";
+#ifdef COUNT_NODE_ALLOCATIONS
+    cout << "Average heap allocations per run: " << (double)total_allocations_all_runs / runs << "\n";
+#endif
     cout << "Average Throughput (K ops/sec): " << avg_throughput_kops_sec << "\n";
 
+    return avg_throughput_kops_sec;
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        int error = parse_args(argv[i]);
+        if (error == 1)
+        {
+            cout << "Argument error, terminating run.\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+#if defined(USE_BOOST_QUEUE)
+    cout << "Using Boost Lock-Free Queue" << endl;
+#elif defined(USE_BOUNDED_QUEUE)
+    cout << "Using Bounded MPMC Queue" << endl;
+#elif defined(USE_SEGMENTED_QUEUE)
+    cout << "Using Segmented FAA Queue" << endl;
+#else
+    cout << "Using Custom Lock-Free Queue" << endl;
+#endif
+    cout << "Total Ops: " << NUM_OPS << endl;
+    if (SCALING)
+        cout << "Threads: 1 to " << std::max(1u, std::thread::hardware_concurrency()) << endl;
+    else
+        cout << "Threads: " << NUM_THREADS << endl;
+    cout << "Runs: " << runs << endl;
+#ifndef HAS_BULK_OPS
+    if (BATCH_SIZE > 1)
+    {
+        cout << "Batches need the custom LockFreeQueue.\n";
+        exit(EXIT_FAILURE);
+    }
+#endif
+    cout << "Batch size: " << BATCH_SIZE << endl;
+
+    path cwd = std::filesystem::current_path();
+    path path_insert_values = cwd / "random_values_insert.bin";
+
+    assert(std::filesystem::exists(path_insert_values));
+
+    uint64_t max_possible_enqueues = NUM_OPS;
+    auto *values_insert = new uint32_t[max_possible_enqueues];
+    read_data(path_insert_values, max_possible_enqueues, values_insert);
+
+    if (SCALING)
+    {
+        // 1, 2, 4, ... threads, and all hardware threads last
+        unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::pair<unsigned int, double>> scaling;
+        for (unsigned int t = 1;; t = std::min(2 * t, max_threads))
+        {
+            NUM_THREADS = t;
+            cout << "\nThreads: " << NUM_THREADS << endl;
+            scaling.push_back({t, run_benchmark(values_insert)});
+            if (t == max_threads)
+                break;
+        }
+        cout << "\nThreads, Throughput (K ops/sec):\n";
+        for (const auto &[t, kops] : scaling)
+        {
+            cout << t << ", " << kops << "\n";
+        }
+    }
+    else
+    {
+        run_benchmark(values_insert);
+    }
+
     delete[] values_insert;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "segmentedqueue.h"
+#include "../epoch.h"
+
+SegmentedQueue::Segment::Segment()
+{
+    for (size_t i = 0; i < SEGMENT_SIZE; ++i)
+    {
+        slots[i].store(EMPTY, std::memory_order_relaxed);
+    }
+}
+
+SegmentedQueue::SegmentedQueue()
+{
+    Segment *s = new Segment();
+    head.store(s, std::memory_order_relaxed);
+    tail.store(s, std::memory_order_relaxed);
+}
+
+SegmentedQueue::~SegmentedQueue()
+{
+    Segment *s = head.load();
+    while (s != nullptr)
+    {
+        Segment *next = s->next.load();
+        delete s;
+        s = next;
+    }
+}
+
+bool SegmentedQueue::enq(uint32_t x)
+{
+    uint64_t item = static_cast<uint64_t>(x) + VALUE_BASE;
+    EpochGuard guard;
+    while (true)
+    {
+        Segment *last = tail.load(std::memory_order_acquire);
+        size_t idx = last->enq_idx.fetch_add(1, std::memory_order_relaxed);
+        if (idx < SEGMENT_SIZE)
+        {
+            // a consumer that got here first has skipped the slot, take another one
+            if (last->slots[idx].exchange(item, std::memory_order_acq_rel) == EMPTY)
+                return true;
+            continue;
+        }
+
+        // last is full
+        Segment *next = last->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            Segment *fresh = new Segment();
+            fresh->slots[0].store(item, std::memory_order_relaxed);
+            fresh->enq_idx.store(1, std::memory_order_relaxed);
+            if (last->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                tail.compare_exchange_strong(last, fresh, std::memory_order_release, std::memory_order_relaxed);
+                return true;
+            }
+            delete fresh; // another producer linked one first, ours was never visible
+        }
+        tail.compare_exchange_strong(last, next, std::memory_order_release, std::memory_order_relaxed);
+    }
+}
+
+int SegmentedQueue::deq()
+{
+    EpochGuard guard;
+    while (true)
+    {
+        Segment *first = head.load(std::memory_order_acquire);
+        // don't skip slots, and make producers retry, when there is nothing to take
+        if (first->deq_idx.load(std::memory_order_relaxed) >= first->enq_idx.load(std::memory_order_relaxed) &&
+            first->next.load(std::memory_order_acquire) == nullptr)
+            return -1;
+        size_t idx = first->deq_idx.fetch_add(1, std::memory_order_relaxed);
+        if (idx < SEGMENT_SIZE)
+        {
+            uint64_t item = first->slots[idx].exchange(TAKEN, std::memory_order_acq_rel);
+            if (item != EMPTY)
+                return static_cast<int>(item - VALUE_BASE);
+            // its producer is late, it will see TAKEN and retry elsewhere
+            continue;
+        }
+
+        // first is drained
+        Segment *next = first->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return -1;
+        // tail must not be left on a retired segment
+        Segment *last = first;
+        tail.compare_exchange_strong(last, next, std::memory_order_release, std::memory_order_relaxed);
+        if (head.compare_exchange_strong(first, next, std::memory_order_release, std::memory_order_relaxed))
+            Epoch::retire(first);
+    }
+}
@@ -0,0 +1,51 @@
+// segmentedqueue.h
+#ifndef SEGMENTED_QUEUE_H
+#define SEGMENTED_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Unbounded MPMC queue made of linked array segments (FAA array queue, in the
+// family of LCRQ and LPRQ). Producers and consumers claim slots with a fetch_add on
+// the segment's index instead of a CAS loop on the queue's ends, so contended threads
+// each get a slot rather than retrying. A slot is then settled with one exchange:
+// whoever gets there first decides whether it carries a value or is skipped. A new
+// segment is only linked in when the last one is full, and drained segments are
+// freed through the epoch reclaimer (epoch.h).
+class SegmentedQueue
+{
+private:
+    static constexpr size_t SEGMENT_SIZE = 1024;
+    // slot states besides a value, which is stored as val + VALUE_BASE
+    static constexpr uint64_t EMPTY = 0;
+    static constexpr uint64_t TAKEN = 1;
+    static constexpr uint64_t VALUE_BASE = 2;
+
+    struct Segment
+    {
+        alignas(64) std::atomic<size_t> deq_idx{0};
+        alignas(64) std::atomic<size_t> enq_idx{0};
+        alignas(64) std::atomic<Segment *> next{nullptr};
+        std::atomic<uint64_t> slots[SEGMENT_SIZE];
+
+        Segment();
+    };
+
+    alignas(64) std::atomic<Segment *> head;
+    alignas(64) std::atomic<Segment *> tail;
+
+public:
+    SegmentedQueue();
+    // Not thread-safe. Assumes queue is quiescent.
+    ~SegmentedQueue();
+
+    SegmentedQueue(const SegmentedQueue &) = delete;
+    SegmentedQueue &operator=(const SegmentedQueue &) = delete;
+
+    bool enq(uint32_t x);
+    // -1 if the queue is empty
+    int deq();
+};
+
+#endif
@@ -0,0 +1,183 @@
+// slab_pool.h
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Slab allocator for fixed size objects that have an atomic `next` link, used to
+// chain them in free lists. Objects are carved out of SLAB_SIZE slabs and cached per
+// thread, so alloc()/release() take no lock in the common case. Memory only goes
+// back to the system when the pool is destroyed, all slabs at once. Until then a
+// released object stays a valid T, which lock-free readers rely on.
+template <typename T>
+class SlabPool
+{
+    static_assert(std::is_trivially_destructible<T>::value, "slabs are freed without destroying their objects");
+
+private:
+    static constexpr size_t SLAB_SIZE = 1024; // objects per slab
+    static constexpr size_t BATCH = 64;       // objects moved between a thread cache and the depot
+
+    // Objects released by threads that went away, shared by all threads of the pool.
+    struct Depot
+    {
+        std::mutex mtx;
+        bool alive = true;
+        T *free = nullptr;
+        size_t free_count = 0;
+        std::vector<T *> slabs;
+    };
+
+    // A thread caches objects of the last pool it used.
+    struct Cache
+    {
+        std::shared_ptr<Depot> depot;
+        T *free = nullptr;
+        size_t free_count = 0;
+        T *bump = nullptr; // unused part of the last slab
+        T *bump_end = nullptr;
+
+        ~Cache() { flush(); }
+
+        // hands every cached object back to the depot, if its pool is still there
+        void flush()
+        {
+            if (depot == nullptr)
+                return;
+            std::shared_ptr<Depot> d = std::move(depot);
+            {
+                std::lock_guard<std::mutex> lock(d->mtx);
+                if (d->alive)
+                {
+                    while (bump != bump_end)
+                    {
+                        push(new (bump++) T());
+                    }
+                    while (free != nullptr)
+                    {
+                        T *obj = free;
+                        free = obj->next.load(std::memory_order_relaxed);
+                        obj->next.store(d->free, std::memory_order_relaxed);
+                        d->free = obj;
+                        d->free_count++;
+                    }
+                }
+            }
+            free = nullptr;
+            free_count = 0;
+            bump = bump_end = nullptr;
+        }
+
+        void push(T *obj)
+        {
+            obj->next.store(free, std::memory_order_relaxed);
+            free = obj;
+            free_count++;
+        }
+
+        T *pop()
+        {
+            T *obj = free;
+            free = obj->next.load(std::memory_order_relaxed);
+            free_count--;
+            return obj;
+        }
+    };
+
+    std::shared_ptr<Depot> depot;
+
+    Cache &cache()
+    {
+        static thread_local Cache c;
+        if (c.depot != depot)
+        {
+            c.flush();
+            c.depot = depot;
+        }
+        return c;
+    }
+
+    void refill(Cache &c)
+    {
+        std::lock_guard<std::mutex> lock(depot->mtx);
+        if (depot->free != nullptr)
+        {
+            for (size_t n = 0; n < BATCH && depot->free != nullptr; ++n)
+            {
+                T *obj = depot->free;
+                depot->free = obj->next.load(std::memory_order_relaxed);
+                depot->free_count--;
+                c.push(obj);
+            }
+            return;
+        }
+        T *slab = static_cast<T *>(::operator new(SLAB_SIZE * sizeof(T), std::align_val_t(alignof(T))));
+        depot->slabs.push_back(slab);
+        c.bump = slab;
+        c.bump_end = slab + SLAB_SIZE;
+    }
+
+    // keeps one thread that only releases from hoarding everything
+    void spill(Cache &c)
+    {
+        std::lock_guard<std::mutex> lock(depot->mtx);
+        for (size_t n = 0; n < BATCH; ++n)
+        {
+            T *obj = c.pop();
+            obj->next.store(depot->free, std::memory_order_relaxed);
+            depot->free = obj;
+            depot->free_count++;
+        }
+    }
+
+public:
+    SlabPool() : depot(std::make_shared<Depot>()) {}
+
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    ~SlabPool()
+    {
+        std::lock_guard<std::mutex> lock(depot->mtx);
+        depot->alive = false;
+        for (T *slab : depot->slabs)
+        {
+            ::operator delete(slab, std::align_val_t(alignof(T)));
+        }
+        depot->slabs.clear();
+        depot->free = nullptr;
+    }
+
+    // A recycled object keeps whatever state it was released with.
+    T *alloc()
+    {
+        Cache &c = cache();
+        if (c.free == nullptr && c.bump == c.bump_end)
+            refill(c);
+        if (c.free != nullptr)
+            return c.pop();
+        return new (c.bump++) T();
+    }
+
+    void release(T *obj)
+    {
+        Cache &c = cache();
+        c.push(obj);
+        if (c.free_count >= 4 * BATCH)
+            spill(c);
+    }
+
+    size_t slab_count()
+    {
+        std::lock_guard<std::mutex> lock(depot->mtx);
+        return depot->slabs.size();
+    }
+};
+
+#endif